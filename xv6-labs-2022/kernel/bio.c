@@ -12,43 +12,268 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// The buffers themselves come from kalloc(), in groups of
+// GROUPBUFS: one page holds the group's buf headers and
+// GROUPBUFS/BPP more pages hold their data. binit() sizes the
+// cache to 1/BCACHEFRAC of physical memory. When kalloc() runs
+// out of pages it calls bshrink(), which hands back a group
+// none of whose buffers is in use; the cache then stays small
+// for BREGROW ticks before misses grow it back. If every buffer
+// is in use, bget() grows the cache rather than panic.
+//
+// Replacement. With a single LRU list, one sequential read of
+// a big file pushes every hot bitmap and inode block out of the
+// cache. The default policy, B2Q, is a simplified 2Q: a newly
+// cached block enters the A1 list, which is FIFO -- hits do not
+// move it -- and is promoted to the Am list, which is LRU, only
+// if it is used again after at least Kin/2 further misses, where
+// Kin (a quarter of the cache) bounds A1. Blocks streamed
+// through once, or used a few times in quick succession as a
+// read() walks a block, age out of A1 without touching Am.
+// Victims come from A1 while it holds more than Kin buffers,
+// else from Am. BLRU keeps the old single-list behavior, for
+// comparison (see user/scanbench.c).
 
 
 #include "types.h"
 #include "param.h"
+#include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "iostat.h"
+
+#define BPP       (PGSIZE / BSIZE)  // buffers per data page
+// buffers per group: as many as fit in the header page, in
+// whole data pages.
+#define GROUPBUFS (BPP * ((PGSIZE - sizeof(void*)) / \
+                          (sizeof(uchar*) + BPP * sizeof(struct buf))))
+#define NBUCKET   1031              // hash buckets for cached blocks
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
+
+struct bgroup {
+  struct bgroup *next;
+  uchar *data[GROUPBUFS / BPP];
+  struct buf buf[GROUPBUFS];
+};
+
+// fails to compile if a group's headers outgrow their page.
+typedef char bgroup_fits[sizeof(struct bgroup) <= PGSIZE ? 1 : -1];
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct bgroup *groups;
+  int nbuf;        // buffers in all groups
+  int target;      // size to grow back to after a shrink
+  uint lastshrink; // ticks at the last bshrink()
+
+  // Cached blocks, hashed on (dev, blockno), chained
+  // through hnext. Buffers holding no block have dev 0
+  // and are not in the hash table.
+  struct buf *hash[NBUCKET];
+
+  // The A1 and Am lists hold all buffers, through prev/next.
+  // a1.next is the newest in A1, a1.prev the oldest.
+  // am.next is the most recently used in Am, am.prev the least.
+  struct buf a1;
+  struct buf am;
+  int na1;         // buffers on the A1 list
+  uint clock;      // misses so far, to age A1 entries
+  int policy;      // BLRU or B2Q
+  uint metaend;    // blocks below this are file system metadata
+  uint gsize;      // and, after it, in each group of gsize
+  uint gmeta;      // blocks, the first gmeta
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  struct bcachestat st;
 } bcache;
 
+static int bgrow(void);
+
 void
 binit(void)
 {
+  initlock(&bcache.lock, "bcache");
+
+  // Create the empty A1 and Am lists
+  bcache.a1.prev = &bcache.a1;
+  bcache.a1.next = &bcache.a1;
+  bcache.am.prev = &bcache.am;
+  bcache.am.next = &bcache.am;
+  bcache.policy = B2Q;
+
+  bcache.target = (PHYSTOP - KERNBASE) / BSIZE / BCACHEFRAC;
+  if(bcache.target < NBUF)
+    bcache.target = NBUF;
+  while(bcache.nbuf < bcache.target)
+    if(bgrow() == 0)
+      panic("binit: out of memory");
+}
+
+// Take b off whichever list it is on.
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  if(b->q == BQ_A1)
+    bcache.na1--;
+}
+
+// Put b at the front (newest end) of list q.
+static void
+bpush(struct buf *b, int q)
+{
+  struct buf *h = q == BQ_A1 ? &bcache.a1 : &bcache.am;
+
+  b->next = h->next;
+  b->prev = h;
+  h->next->prev = b;
+  h->next = b;
+  b->q = q;
+  if(q == BQ_A1)
+    bcache.na1++;
+}
+
+static void
+bhash(struct buf *b)
+{
+  int h = BHASH(b->dev, b->blockno);
+
+  b->hnext = bcache.hash[h];
+  bcache.hash[h] = b;
+}
+
+static void
+bunhash(struct buf *b)
+{
+  struct buf **pp;
+
+  if(b->dev == 0)
+    return;
+  for(pp = &bcache.hash[BHASH(b->dev, b->blockno)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      return;
+    }
+  }
+  panic("bunhash");
+}
+
+// Add a group of buffers at the oldest end of A1.
+// Called without bcache.lock, since kalloc() may call
+// bshrink(). Returns 0 if out of memory.
+static int
+bgrow(void)
+{
+  struct bgroup *g;
   struct buf *b;
+  int i;
 
-  initlock(&bcache.lock, "bcache");
+  if((g = kalloc()) == 0)
+    return 0;
+  memset(g, 0, sizeof(*g));
+  for(i = 0; i < GROUPBUFS / BPP; i++){
+    if((g->data[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(g->data[i]);
+      kfree(g);
+      return 0;
+    }
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  acquire(&bcache.lock);
+  for(i = 0; i < GROUPBUFS; i++){
+    b = &g->buf[i];
+    b->data = g->data[i / BPP] + (i % BPP) * BSIZE;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->q = BQ_A1;
+    b->prev = bcache.a1.prev;
+    b->next = &bcache.a1;
+    bcache.a1.prev->next = b;
+    bcache.a1.prev = b;
+    bcache.na1++;
+  }
+  g->next = bcache.groups;
+  bcache.groups = g;
+  bcache.nbuf += GROUPBUFS;
+  bcache.st.grows++;
+  release(&bcache.lock);
+  return 1;
+}
+
+// Give a group none of whose buffers is in use back
+// to kalloc(). Called by kalloc() when it runs out of pages.
+// Returns the number of pages freed.
+int
+bshrink(void)
+{
+  struct bgroup *g, **pg;
+  struct buf *b;
+  int i;
+
+  acquire(&bcache.lock);
+  for(pg = &bcache.groups; (g = *pg) != 0; pg = &g->next){
+    if(bcache.nbuf - GROUPBUFS < NBUF)
+      break;
+    for(i = 0; i < GROUPBUFS; i++)
+      if(g->buf[i].refcnt != 0)
+        break;
+    if(i < GROUPBUFS)
+      continue;
+
+    for(i = 0; i < GROUPBUFS; i++){
+      b = &g->buf[i];
+      bunhash(b);
+      bunlink(b);
+    }
+    *pg = g->next;
+    bcache.nbuf -= GROUPBUFS;
+    bcache.st.shrinks++;
+    bcache.lastshrink = ticks;
+    release(&bcache.lock);
+
+    for(i = 0; i < GROUPBUFS / BPP; i++)
+      kfree(g->data[i]);
+    kfree(g);
+    return GROUPBUFS / BPP + 1;
+  }
+  release(&bcache.lock);
+  return 0;
+}
+
+// Find an unused buffer to recycle, or return 0.
+static struct buf*
+bvictim(void)
+{
+  struct buf *h, *b;
+  int i;
+
+  h = bcache.na1 > bcache.nbuf / 4 ? &bcache.a1 : &bcache.am;
+  for(i = 0; i < 2; i++){
+    for(b = h->prev; b != h; b = b->prev)
+      if(b->refcnt == 0)
+        return b;
+    h = h == &bcache.a1 ? &bcache.am : &bcache.a1;
+  }
+  return 0;
+}
+
+static void
+bcount(struct buf *b, int hit)
+{
+  int meta = b->blockno < bcache.metaend ||
+    (bcache.gsize && (b->blockno - bcache.metaend) % bcache.gsize < bcache.gmeta);
+
+  if(hit){
+    bcache.st.hits++;
+    bcache.st.metahits += meta;
+  } else {
+    bcache.st.misses++;
+    bcache.st.metamisses += meta;
   }
 }
 
@@ -59,33 +284,61 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
+  int grow, grown;
 
   acquire(&bcache.lock);
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  for(;;){
+    // Is the block already cached?
+    for(b = bcache.hash[BHASH(dev, blockno)]; b != 0; b = b->hnext){
+      if(b->dev == dev && b->blockno == blockno){
+        b->refcnt++;
+        bcount(b, 1);
+        if(b->q == BQ_A1 &&
+           (bcache.policy == BLRU || bcache.clock - b->stamp >= bcache.nbuf / 8)){
+          bunlink(b);
+          bpush(b, BQ_AM);
+        }
+        release(&bcache.lock);
+        acquiresleep(&b->lock);
+        return b;
+      }
     }
-  }
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
+    // Not cached.
+    // Grow back toward the boot-time size unless memory
+    // was short recently, else recycle an unused buffer.
+    grow = bcache.nbuf < bcache.target && ticks - bcache.lastshrink > BREGROW;
+    if(!grow && (b = bvictim()) != 0){
+      if(b->valid)
+        bcache.st.evictions++;
+      bunhash(b);
       b->dev = dev;
       b->blockno = blockno;
       b->valid = 0;
       b->refcnt = 1;
+      bhash(b);
+      bcount(b, 0);
+      bunlink(b);
+      bpush(b, bcache.policy == BLRU ? BQ_AM : BQ_A1);
+      b->stamp = bcache.clock++;
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
+
+    // Every buffer is in use, or the cache may grow.
+    // Another process may cache the block while we
+    // allocate, so look again afterwards.
+    release(&bcache.lock);
+    grown = bgrow();
+    acquire(&bcache.lock);
+    if(!grown){
+      if(!grow)
+        panic("bget: no buffers");
+      bcache.lastshrink = ticks;
+    }
   }
-  panic("bget: no buffers");
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,23 +349,60 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0); // 从磁盘上读取出数据
+    blk_submit(b, 0); // 从磁盘上读取出数据
+    blk_wait(b);
     b->valid = 1;
   }
   return b;
 }
 
+// Return a locked buf for the indicated block without
+// reading it from disk, for a caller that is about to
+// overwrite the whole block. If the block isn't cached,
+// b->valid is 0 and the caller sets it once b->data
+// holds the new contents; leaving it 0 (e.g. after a
+// failed copy) makes the next bread() go to the disk.
+struct buf*
+bfresh(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(!b->valid)
+    __sync_fetch_and_add(&bcache.st.noreads, 1);
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
+{
+  bwrite_start(b);
+  bwait(b);
+}
+
+// Start writing b's contents to disk, without waiting.
+// Must be locked until bwait(b) returns.
+// Writes started between blk_plug() and blk_unplug()
+// are sorted and merged as a batch.
+void
+bwrite_start(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  __sync_fetch_and_add(&bcache.st.writes, 1);
+  blk_submit(b, 1);
+}
+
+// Wait for a write started by bwrite_start().
+void
+bwait(struct buf *b)
+{
+  blk_wait(b);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// If it is on the Am list, move it to the most-recently-used end.
 void
 brelse(struct buf *b)
 {
@@ -123,23 +413,22 @@ brelse(struct buf *b)
 
   acquire(&bcache.lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
+  if (b->refcnt == 0 && b->q == BQ_AM) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bunlink(b);
+    bpush(b, BQ_AM);
   }
-  
+
   release(&bcache.lock);
 }
 
+// The log pins the blocks of a transaction in the
+// cache until it has installed them: they are dirty.
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
   b->refcnt++;
+  bcache.st.dirty++;
   release(&bcache.lock);
 }
 
@@ -147,7 +436,49 @@ void
 bunpin(struct buf *b) {
   acquire(&bcache.lock);
   b->refcnt--;
+  bcache.st.dirty--;
+  release(&bcache.lock);
+}
+
+// Copy out the buffer cache counters.
+void
+bstat(struct bcachestat *st)
+{
+  acquire(&bcache.lock);
+  *st = bcache.st;
+  st->nbuf = bcache.nbuf;
+  st->target = bcache.target;
+  st->na1 = bcache.na1;
+  st->policy = bcache.policy;
   release(&bcache.lock);
 }
 
+// Select the replacement policy, BLRU or B2Q.
+// Returns the old policy, or -1 for a bad one.
+int
+bsetpolicy(int policy)
+{
+  int old;
+
+  if(policy != BLRU && policy != B2Q)
+    return -1;
+  acquire(&bcache.lock);
+  old = bcache.policy;
+  bcache.policy = policy;
+  release(&bcache.lock);
+  return old;
+}
 
+// Blocks below end (boot block through the free bitmap),
+// and, if gsize isn't 0, the first gmeta blocks of each
+// group of gsize blocks after it (a block group's bitmap
+// and inodes), are counted as metadata in the statistics.
+void
+bsetmeta(uint end, uint gsize, uint gmeta)
+{
+  acquire(&bcache.lock);
+  bcache.metaend = end;
+  bcache.gsize = gsize;
+  bcache.gmeta = gmeta;
+  release(&bcache.lock);
+}
@@ -0,0 +1,211 @@
+//
+// Block I/O request queue, between the buffer cache
+// and the virtio disk driver.
+//
+// bread() and bwrite() hand each buf to blk_submit(),
+// which keeps pending requests in a list sorted by block
+// number and feeds them to the disk in elevator (C-LOOK)
+// order, merging runs of consecutive blocks going the
+// same way into one request of up to MAXRWV blocks.
+// A request that has waited past its deadline goes next
+// regardless of where the elevator is, so a stream of
+// nearby requests cannot starve a distant one.
+//
+// A process can plug the queue around a batch of
+// submissions with blk_plug()/blk_unplug(); until it
+// unplugs, or waits for one of them, its requests
+// collect privately and so are sorted and merged as a
+// batch rather than dispatched one by one.
+//
+// The disk has room for a limited number of requests;
+// the rest wait in the queue until completions make
+// room, at which point the driver calls blk_dispatch().
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "iostat.h"
+
+// time a request may wait before it is served out of order.
+#define READDEADLINE  (CLINT_HZ / 20)   // 50 ms
+#define WRITEDEADLINE (CLINT_HZ / 2)    // 500 ms
+
+struct {
+  struct spinlock lock;
+  struct buf *head;  // pending requests, sorted by dev, blockno
+  uint pos;          // block after the last one dispatched
+  int n;             // requests in the queue
+  uint64 expired;    // dispatched early for their deadline
+  uint64 merged;     // requests merged into a neighbour's
+} blk;
+
+void
+blkinit(void)
+{
+  initlock(&blk.lock, "blk");
+}
+
+static int
+before(struct buf *a, struct buf *b)
+{
+  return a->dev < b->dev || (a->dev == b->dev && a->blockno < b->blockno);
+}
+
+// insert b into the sorted queue.
+// caller holds blk.lock.
+static void
+enqueue(struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &blk.head; *pp && before(*pp, b); pp = &(*pp)->qnext)
+    ;
+  b->qnext = *pp;
+  *pp = b;
+  blk.n++;
+}
+
+// choose the next request to dispatch: the oldest one
+// if it is past its deadline, else the first at or
+// beyond the elevator's position, wrapping to the start.
+// caller holds blk.lock.
+static struct buf*
+pick(void)
+{
+  struct buf *b, *old;
+  uint64 now;
+
+  now = r_time();
+  old = 0;
+  for(b = blk.head; b; b = b->qnext)
+    if(old == 0 || b->qtime < old->qtime)
+      old = b;
+  if(old && now - old->qtime > (old->qwrite ? WRITEDEADLINE : READDEADLINE)){
+    blk.expired++;
+    return old;
+  }
+  for(b = blk.head; b; b = b->qnext)
+    if(b->blockno >= blk.pos)
+      return b;
+  return blk.head;
+}
+
+// start as many queued requests as the disk will take.
+void
+blk_dispatch(void)
+{
+  struct buf *run[MAXRWV], *b, *x, **pp;
+  int i, n;
+
+  acquire(&blk.lock);
+  while(blk.head){
+    b = pick();
+    run[0] = b;
+    n = 1;
+    for(x = b->qnext; x && n < MAXRWV; x = x->qnext){
+      if(x->dev != b->dev || x->blockno != b->blockno + n || x->qwrite != b->qwrite)
+        break;
+      run[n++] = x;
+    }
+    if(virtio_disk_start(run, n, b->qwrite) < 0)
+      break;  // disk is full; a completion will call us again
+    // the run is contiguous in the queue; unlink it.
+    for(pp = &blk.head; *pp != b; pp = &(*pp)->qnext)
+      ;
+    *pp = run[n-1]->qnext;
+    for(i = 0; i < n; i++)
+      run[i]->qnext = 0;
+    blk.n -= n;
+    blk.merged += n - 1;
+    blk.pos = run[n-1]->blockno + 1;
+  }
+  release(&blk.lock);
+}
+
+// move p's plugged requests to the queue and dispatch.
+static void
+flush(struct proc *p)
+{
+  struct buf *b;
+
+  acquire(&blk.lock);
+  while((b = p->plugq) != 0){
+    p->plugq = b->qnext;
+    enqueue(b);
+  }
+  release(&blk.lock);
+  blk_dispatch();
+}
+
+// queue b to be read from or written to disk.
+// b must be locked; blk_wait() waits for the transfer.
+void
+blk_submit(struct buf *b, int write)
+{
+  struct proc *p = myproc();
+
+  if(b->disk)
+    panic("blk_submit");
+  b->disk = 1;
+  b->qwrite = write;
+  b->qtime = r_time();
+  if(p && p->plugged){
+    b->qnext = p->plugq;
+    p->plugq = b;
+    return;
+  }
+  acquire(&blk.lock);
+  enqueue(b);
+  release(&blk.lock);
+  blk_dispatch();
+}
+
+// wait for the disk to finish with b.
+void
+blk_wait(struct buf *b)
+{
+  struct proc *p = myproc();
+
+  // don't sleep on requests that are still plugged.
+  if(p && p->plugq)
+    flush(p);
+  virtio_disk_wait(b);
+}
+
+// hold back this process's requests until blk_unplug().
+// plugs nest.
+void
+blk_plug(void)
+{
+  myproc()->plugged++;
+}
+
+void
+blk_unplug(void)
+{
+  struct proc *p = myproc();
+
+  if(p->plugged < 1)
+    panic("blk_unplug");
+  if(--p->plugged == 0 && p->plugq)
+    flush(p);
+}
+
+// add the queue's counters to st.
+void
+blkstat(struct diskstat *st)
+{
+  acquire(&blk.lock);
+  st->queued = blk.n;
+  st->merged = blk.merged;
+  st->expired = blk.expired;
+  release(&blk.lock);
+}
@@ -7,6 +7,17 @@ struct buf {
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
-  uchar data[BSIZE];
+  struct buf *hnext; // hash chain
+  int q;             // replacement list: BQ_A1 or BQ_AM
+  uint stamp;        // bcache miss clock when cached
+  struct buf *qnext; // blk.c request queue
+  uint64 qtime;      // when queued, for the deadline
+  int qwrite;        // queued to be written (vs read)
+  int logged;        // committed log transactions holding it,
+                     // not yet checkpointed
+  uchar *data;       // BSIZE bytes in a kalloc() page
 };
 
+
+#define BQ_A1 0  // seen once recently (FIFO)
+#define BQ_AM 1  // re-referenced (LRU)
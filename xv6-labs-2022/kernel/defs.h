@@ -1,7 +1,11 @@
+struct bcachestat;
 struct buf;
+struct diskstat;
 struct context;
+struct direntplus;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -12,10 +16,26 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bfresh(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwrite_start(struct buf*);
+void            bwait(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(void);
+void            bstat(struct bcachestat*);
+int             bsetpolicy(int);
+void            bsetmeta(uint, uint, uint);
+
+// blk.c
+void            blkinit(void);
+void            blk_submit(struct buf*, int);
+void            blk_wait(struct buf*);
+void            blk_dispatch(void);
+void            blk_plug(void);
+void            blk_unplug(void);
+void            blkstat(struct diskstat*);
 
 // console.c
 void            consoleinit(void);
@@ -33,12 +53,17 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int, uint64*);
+int             filewritev(struct file*, struct iovec*, int, uint64*);
+long            fileseek(struct file*, long, int);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+int             dirread(struct inode*, uint64*, struct direntplus*, int, int);
+int             nbitmap(void);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+struct inode*   ialloc(uint, short, uint);
 struct inode*   idup(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
@@ -49,9 +74,12 @@ void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
-int             readi(struct inode*, int, uint64, uint, uint);
+struct inode*   nameilink(char*);
+struct inode*   nameiat(struct inode*, char*, int);
+struct inode*   nameiparentat(struct inode*, char*, char*);
+int             readi(struct inode*, int, uint64, uint64, uint);
 void            stati(struct inode*, struct stat*);
-int             writei(struct inode*, int, uint64, uint, uint);
+int             writei(struct inode*, int, uint64, uint64, uint);
 void            itrunc(struct inode*);
 
 // ramdisk.c
@@ -67,7 +95,10 @@ void            kinit(void);
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_write_range(struct buf*, uint, uint);
+void            log_write_data(struct buf*);
 void            begin_op(void);
+void            begin_opn(int, int);
 void            end_op(void);
 
 // pipe.c
@@ -81,10 +112,17 @@ void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// prof.c
+void            profinit(void);
+void            profintr(void);
+int             profctl(int);
+int             profread(uint64, int);
+
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+void            kproc(void (*)(void), char*);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
@@ -141,6 +179,9 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// sysfile.c
+void            renameinit(void);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -182,7 +223,10 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_start(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
+int             virtio_disk_poll(int);
+void            virtio_disk_stat(struct diskstat*);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -4,3 +4,12 @@
 #define O_NOFOLLOW 0x004
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// lseek whence
+#define SEEK_SET  0
+#define SEEK_CUR  1
+#define SEEK_END  2
+
+// *at() calls
+#define AT_FDCWD  -100             // dirfd: the current directory
+#define AT_SYMLINK_NOFOLLOW 0x100  // fstatat: don't follow a final symlink
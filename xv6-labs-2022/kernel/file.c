@@ -12,6 +12,8 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "fcntl.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -108,86 +110,208 @@ filestat(struct file *f, uint64 addr)
 
 // fileread根据不同的底层文件类型，检查文件可读模式是否打开，然后调用不同的方法来读取这些资源，为系统调用read提供服务。
 // fileread和接下来的filewrite都使用了struct file中的偏移量off，每次读完之后就更新它，有一个例外是管道，管道没有偏移量。
-// Read from file f.
-// addr is a user virtual address.
+// Read from file f into the n buffers of iov, which are
+// user virtual addresses, at *off if off isn't 0 and
+// otherwise at f's offset, which moves past the data read.
+// Stops at the first short read.
 int
-fileread(struct file *f, uint64 addr, int n)
+filereadv(struct file *f, struct iovec *iov, int n, uint64 *off)
 {
-  int r = 0;
+  int i, r, tot;
 
   if(f->readable == 0)
     return -1;
+  if(off && f->type != FD_INODE)
+    return -1;  // no offsets in pipes and devices
 
-  if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
-      return -1;
-    r = devsw[f->major].read(1, addr, n);
-  } else if(f->type == FD_INODE){
+  tot = 0;
+  if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
+    if(off == 0)
+      off = &f->off;
+    for(i = 0; i < n; i++){
+      if((r = readi(f->ip, 1, (uint64)iov[i].iov_base, *off, iov[i].iov_len)) < 0){
+        tot = tot ? tot : -1;
+        break;
+      }
+      *off += r;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
     iunlock(f->ip);
-  } else {
-    panic("fileread");
+    return tot;
   }
 
-  return r;
+  for(i = 0; i < n; i++){
+    if(f->type == FD_PIPE){
+      r = piperead(f->pipe, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+        return -1;
+      r = devsw[f->major].read(1, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else {
+      panic("fileread");
+    }
+    if(r < 0){
+      tot = tot ? tot : -1;
+      break;
+    }
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
 }
 
-// fileread和filewrite中利用了ilock的锁机制，读取和写入的偏移量都将会原子地更新，因此对同一文件的多次写入不会覆盖彼此的数据，
-// 对同一文件的多次读也不会读出重复的数据。利用ilock的锁机制，我们不需要在struct file中再额外添加一把锁保护off。
-
-// filewrite如下，和fileread类似，这次检查写模式是否打开，它为系统调用write提供服务。
-// Write to file f.
+// Read from file f.
 // addr is a user virtual address.
 int
-filewrite(struct file *f, uint64 addr, int n)
+fileread(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1, 0);
+}
+
+// Write the n buffers of iov, which are user virtual
+// addresses, to file f, at *off if off isn't 0 and otherwise
+// at f's offset, which moves past the data written.
+int
+filewritev(struct file *f, struct iovec *iov, int n, uint64 *off)
 {
-  int r, ret = 0;
+  int i, r, tot;
+  uint64 done, n1, left;
 
   if(f->writable == 0)
     return -1;
+  if(off && f->type != FD_INODE)
+    return -1;  // no offsets in pipes and devices
 
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
-      return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
+  tot = 0;
+  if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // the maximum log transaction size. file data is
+    // not logged, so a chunk needs log space only for
+    // the i-node, up to NLEVEL+1 indirect blocks (a chunk
+    // crossing into a new subtree touches the old leaf and
+    // a new block at each level) and free-map blocks. each
+    // allocation, of a data block or a new indirect block,
+    // may use a different free-map block when balloc()
+    // moves on to another group or reuses freed blocks, so
+    // count one per allocation, up to nbitmap(). it also
+    // needs a slot on the ordered list for each data block:
+    // the chunk's, one more if it isn't aligned, and one
+    // for iexpand(). two chunks fit on the list, so two
+    // writers can share a commit.
+    // other inodes log their data,
+    // with 2 blocks of slop for non-aligned writes.
+    // a chunk takes in as many buffers as fit, so a
+    // writev() of small buffers commits once.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
+    int need = MAXOPBLOCKS;
+    int nd = 0;
+    if(f->ip->type == T_FILE){
+      nd = NORDERED / 2;
+      max = (nd - 2) * BSIZE;
+      need = nd + NLEVEL < nbitmap() ? nd + NLEVEL : nbitmap();
+      need += 1 + (NLEVEL+1);
+    }
+    if(off == 0)
+      off = &f->off;
+    i = 0;
+    done = 0;  // bytes of iov[i] written
+    r = 0;
     while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
+      begin_opn(need, nd);
       ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      for(left = max; i < n && left > 0; left -= r){
+        n1 = iov[i].iov_len - done;
+        if(n1 > left)
+          n1 = left;
+        if((r = writei(f->ip, 1, (uint64)iov[i].iov_base + done, *off, n1)) > 0){
+          *off += r;
+          tot += r;
+          done += r;
+        }
+        if(r != n1)
+          break;  // error from writei
+        if(done == iov[i].iov_len){
+          i++;
+          done = 0;
+        }
+      }
       iunlock(f->ip);
       end_op();
 
-      if(r != n1){
-        // error from writei
-        break;
-      }
-      i += r;
+      if(r != n1)
+        return -1;
     }
-    ret = (i == n ? n : -1);
-  } else {
-    panic("filewrite");
+    return tot;
   }
 
-  return ret;
+  for(i = 0; i < n; i++){
+    if(f->type == FD_PIPE){
+      r = pipewrite(f->pipe, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+        return -1;
+      r = devsw[f->major].write(1, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else {
+      panic("filewrite");
+    }
+    if(r < 0)
+      return tot ? tot : -1;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
 }
 
+// Write to file f.
+// addr is a user virtual address.
+int
+filewrite(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1, 0);
+}
+
+// Set the offset of file f for the next read or write,
+// relative to whence. It may go past the end of the file;
+// a write there leaves a hole that reads as zeros.
+// Returns the new offset.
+long
+fileseek(struct file *f, long off, int whence)
+{
+  long base;
+
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(whence == SEEK_SET)
+    base = 0;
+  else if(whence == SEEK_CUR)
+    base = f->off;
+  else if(whence == SEEK_END)
+    base = f->ip->size;
+  else {
+    iunlock(f->ip);
+    return -1;
+  }
+  if(base + off < 0 || base + off > MAXFILE*BSIZE){
+    iunlock(f->ip);
+    return -1;
+  }
+  f->off = base + off;
+  iunlock(f->ip);
+  return f->off;
+}
@@ -13,7 +13,7 @@ struct file {
   char writable;
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
-  uint off;          // FD_INODE
+  uint64 off;        // FD_INODE
   short major;       // FD_DEVICE
 };
 
@@ -22,6 +22,8 @@ struct file {
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
 // in-memory copy of an inode
+#define NBMRUN 4
+
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
@@ -32,13 +34,22 @@ struct inode {
   short type;         // copy of disk inode
   short major;
   short minor;
+  short flags;
   short nlink;
-  uint size;
-  // addrs[NDIRECT] addrs[NDIRECT+1] 存的是blockno，而要真正读取对应此判断上具体的block number时
+  uint64 size;
+  // addrs[NDIRECT] .. addrs[NDIRECT+NLEVEL-1] 存的是indirect block的blockno，而要真正读取对应此判断上具体的block number时
   // 要先把addrs[NDIRECT]对应的block(例如addrs[NDIRECT]=1992 ) 加载内存中 对应的内存结构体为buf
   // 再从buf.data上 找到对应的实际物理磁盘的block number
-  // 同理读取addrs[NDIRECT+1]也是如此  --> 改为NDIRECT+2更为合理
-  uint addrs[NDIRECT+2];
+  // 同理读取addrs[NDIRECT+1]、addrs[NDIRECT+2]也是如此，只是要多读一两层
+  uint addrs[NDIRECT+NLEVEL];
+  // runs of consecutive blocks recently found through the
+  // indirect blocks, so bmap() needn't read them again.
+  struct bmrun {
+    uint bn;          // first logical block
+    uint addr;        // its disk block
+    uint n;           // blocks in the run
+  } bmc[NBMRUN];
+  int bmnext;         // entry to replace next
 };
 
 // map major device number to device functions.
@@ -26,6 +26,24 @@
 // only one device
 struct superblock sb; 
 
+// Which inodes are in use, built from the inode blocks at
+// boot so ialloc() can find a free one without reading them.
+struct {
+  struct spinlock lock;
+  uchar *map;        // bit set if the inode is in use
+  uint hint[NCPU];   // where each CPU's next search starts
+  uint dirgroup;     // group for the next directory
+} imap;
+
+// Unlinked files whose blocks are still to be freed.
+struct {
+  struct spinlock lock;
+  int n;           // entries in the on-disk orphan table
+} orphans;
+
+static void reclaimer(void);
+static void imapinit(uint dev);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -43,50 +61,112 @@ fsinit(int dev) {
   readsb(dev, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  if((sb.bsize ? sb.bsize : 1024) != BSIZE)
+    panic("file system block size");
+  if(sb.ngroups)
+    bsetmeta(sb.groupstart, sb.groupsize, 1 + sb.ginodes/IPB);
+  else
+    bsetmeta(sb.bmapstart + sb.size/BPB + 1, 0, 0);
   initlog(dev, &sb);
+  imapinit(dev);
+
+  // finish truncations that a crash interrupted.
+  struct buf *bp = bread(dev, 1);
+  uint *a = (uint*)(bp->data + ORPHANOFF);
+  initlock(&orphans.lock, "orphans");
+  for(int i = 0; i < NORPHAN; i++)
+    if(a[i])
+      orphans.n++;
+  brelse(bp);
+  kproc(reclaimer, "reclaim");
 }
 
+// File data blocks are written in place ahead of the
+// commit rather than logged; everything else is logged.
+#define ORDERED(ip) ((ip)->type == T_FILE)
+
 // Zero a block.
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int ordered)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bfresh(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  bp->valid = 1;
+  if(ordered)
+    log_write_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Find a clear bit in [lo, hi) of free map block bp, set
+// it and log the change. Returns -1 if there is none.
+static int
+bmapfind(struct buf *bp, int lo, int hi)
+{
+  int bi, m;
+
+  for(bi = lo; bi < hi; bi++){
+    m = 1 << (bi % 8);
+    if((bp->data[bi/8] & m) == 0){  // Is block free?
+      bp->data[bi/8] |= m;  // Mark block in use.
+      log_write_range(bp, bi/8, 1);
+      return bi;
+    }
+  }
+  return -1;
+}
+
+// Allocate a zeroed disk block, zeroing it through
+// the ordered list if it will hold file data.
+// With block groups, prefer the group of inode near.
 // returns 0 if out of disk space.
 static uint
-balloc(uint dev)
+balloc(uint dev, int ordered, uint near)
 {
-  int b, bi, m;
+  uint b, g, i;
+  int bi;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));// bread --> bget 先从buffer cache中找编号为 bn 的block 没有的话在从磁盘上加载到内存的buffer cache中
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
+  if(sb.ngroups){
+    for(i = 0; i < sb.ngroups; i++){
+      g = (IGROUP(near, sb) + i) % sb.ngroups;
+      b = GSTART(g, sb);
+      bp = bread(dev, b);  // the group's free map
+      bi = bmapfind(bp, 1 + sb.ginodes/IPB, min(sb.groupsize, sb.size - b));
+      brelse(bp);
+      if(bi >= 0){
+        bzero(dev, b + bi, ordered);
+        return b + bi;
+      }
+    }
+  } else {
+    for(b = 0; b < sb.size; b += BPB){
+      bp = bread(dev, BBLOCK(b, sb));// bread --> bget 先从buffer cache中找编号为 bn 的block 没有的话在从磁盘上加载到内存的buffer cache中
+      bi = bmapfind(bp, 0, min(BPB, sb.size - b));
+      brelse(bp);
+      if(bi >= 0){
+        bzero(dev, b + bi, ordered);
         return b + bi;
       }
     }
-    brelse(bp);
   }
   printf("balloc: out of blocks\n");
   return 0;
 }
 
+// Number of free-map blocks, the most that a run of
+// allocations can touch.
+int
+nbitmap(void)
+{
+  return sb.ngroups ? sb.ngroups : (sb.size + BPB - 1) / BPB;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -95,12 +175,12 @@ bfree(int dev, uint b)
   int bi, m;
 
   bp = bread(dev, BBLOCK(b, sb));
-  bi = b % BPB;
+  bi = BOFF(b, sb);
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
-  log_write(bp);
+  log_write_range(bp, bi/8, 1);
   brelse(bp);
 }
 
@@ -178,41 +258,141 @@ struct {
   struct inode inode[NINODE];
 } itable;
 
+// Recently followed symbolic link targets too long to be
+// inline, so following them again costs no disk reads.
+#define NSYMCACHE 8
+
+struct {
+  struct spinlock lock;
+  struct {
+    uint dev;
+    uint inum;        // 0 if unused
+    char target[MAXPATH];
+  } e[NSYMCACHE];
+  int next;           // entry to replace next
+} symcache;
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&itable.lock, "itable");
+  initlock(&symcache.lock, "symcache");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
   }
 }
 
 static struct inode* iget(uint dev, uint inum);
+static int orphan_add(uint dev, uint inum);
+static void bmflush(struct inode *ip);
+static void symforget(struct inode *ip);
+
+// Read the inode blocks to find the inodes in use.
+static void
+imapinit(uint dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  uint inum;
+  int i;
+
+  if((sb.ninodes + 7) / 8 > PGSIZE)
+    panic("imapinit: too many inodes");
+  initlock(&imap.lock, "imap");
+  if((imap.map = kalloc()) == 0)
+    panic("imapinit");
+  memset(imap.map, 0, PGSIZE);
+  imap.map[0] = 1;  // inode 0 is never used
+  for(inum = 1; inum < sb.ninodes; inum++){
+    bp = bread(dev, IBLOCK(inum, sb));
+    dip = (struct dinode*)bp->data + inum%IPB;
+    if(dip->type != 0)
+      imap.map[inum/8] |= 1 << (inum%8);
+    brelse(bp);
+  }
+  // spread the CPUs' searches over the inodes.
+  for(i = 0; i < NCPU; i++)
+    imap.hint[i] = 1 + i * (sb.ninodes / NCPU);
+}
+
+// Claim a free inode in imap, preferring one in the same
+// inode block as inode near, and with block groups in its
+// group. New directories instead go to the groups in turn,
+// spreading the directories and so their files over the
+// disk. Returns 0 if there is none.
+static uint
+imapget(uint near, int dir)
+{
+  uint inum, first, start, i;
+  int id;
+
+  acquire(&imap.lock);
+  first = near - near%IPB;
+  for(inum = first; near && !dir && inum < first + IPB && inum < sb.ninodes; inum++)
+    if((imap.map[inum/8] & (1 << (inum%8))) == 0)
+      goto found;
+  push_off();
+  id = cpuid();
+  pop_off();
+  if(sb.ngroups && dir)
+    start = (imap.dirgroup++ % sb.ngroups) * sb.ginodes;
+  else if(sb.ngroups)
+    start = IGROUP(near, sb) * sb.ginodes;
+  else
+    start = imap.hint[id];
+  for(i = 0; i < sb.ninodes; i++){
+    inum = (start + i) % sb.ninodes;
+    if((imap.map[inum/8] & (1 << (inum%8))) == 0){
+      if(sb.ngroups == 0)
+        imap.hint[id] = inum + 1;
+      goto found;
+    }
+  }
+  release(&imap.lock);
+  return 0;
+
+found:
+  imap.map[inum/8] |= 1 << (inum%8);
+  release(&imap.lock);
+  return inum;
+}
+
+// Mark inum free in imap.
+static void
+imapput(uint inum)
+{
+  acquire(&imap.lock);
+  imap.map[inum/8] &= ~(1 << (inum%8));
+  release(&imap.lock);
+}
 
-// Allocate an inode on device dev.
+// Allocate an inode on device dev, if possible in the same
+// inode block as inode near (say, its directory's).
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode,
 // or NULL if there is no free inode.
 struct inode*
-ialloc(uint dev, short type)
+ialloc(uint dev, short type, uint near)
 {
-  int inum;
+  uint inum;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  while((inum = imapget(near, type == T_DIR)) != 0){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
+      if(type == T_FILE || type == T_SYMLINK)
+        dip->flags = DI_INLINE;
+      log_write_range(bp, (uchar*)dip - bp->data, sizeof(*dip));   // mark it allocated on the disk
       brelse(bp);
       return iget(dev, inum);
     }
-    brelse(bp);
+    brelse(bp);  // in use after all; leave it marked
   }
   printf("ialloc: no inodes\n");
   return 0;
@@ -233,10 +413,11 @@ iupdate(struct inode *ip)
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
+  dip->flags = ip->flags;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
-  log_write(bp);
+  log_write_range(bp, (uchar*)dip - bp->data, sizeof(*dip));
   brelse(bp);
 }
 
@@ -307,10 +488,12 @@ ilock(struct inode *ip)
     ip->type = dip->type;
     ip->major = dip->major;
     ip->minor = dip->minor;
+    ip->flags = dip->flags;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    bmflush(ip);
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -349,9 +532,14 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
-    itrunc(ip);
-    ip->type = 0;
-    iupdate(ip);
+    // a file with indirect blocks is left to the reclaimer,
+    // which frees its blocks over several transactions.
+    if(ip->size <= NDIRECT*BSIZE || !orphan_add(ip->dev, ip->inum)){
+      itrunc(ip);
+      ip->type = 0;
+      iupdate(ip);
+      imapput(ip->inum);
+    }
     ip->valid = 0;
 
     releasesleep(&ip->lock);
@@ -379,99 +567,155 @@ iunlockput(struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
-// returns 0 if out of disk space.
+// Find which of ip's indirect blocks logical block bn is under:
+// returns the level (1 for singly-indirect, ...) and sets *rem
+// to bn's index among the blocks under it and *first to the
+// logical block number of the first of them.
+static int
+blevel(uint bn, uint *rem, uint *first)
+{
+  uint64 n;
+  int level;
+
+  bn -= NDIRECT;
+  *first = NDIRECT;
+  for(level = 1, n = NINDIRECT; level <= NLEVEL; level++, n *= NINDIRECT){
+    if(bn < n){
+      *rem = bn;
+      return level;
+    }
+    bn -= n;
+    *first += n;
+  }
+  panic("bmap: out of range");
+}
+
+// Blocks under each entry of an indirect block k levels
+// above the data.
+static uint
+bspan(int k)
+{
+  uint n = 1;
+
+  while(--k > 0)
+    n *= NINDIRECT;
+  return n;
+}
+
+// Look up the nth block of ip through its indirect blocks,
+// for bmap().
 static uint
-bmap(struct inode *ip, uint bn)
+bwalk(struct inode *ip, uint bn, int alloc)
 {
-  // addr 应该是物理磁盘的block number，在fs实验中最大为 200000 所以使用uint类型完全够用
-  // addr1 是第一层 indirect block 
-  // addr2 是第二层 indirect block
-  uint addr, *a, addr1, addr2;
+  uint addr, next, *a, rem, first, idx;
   struct buf *bp;
+  int level, k;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
-      if(addr == 0)
+      if(!alloc)
         return 0;
-      ip->addrs[bn] = addr;
-    }
-    return addr;
-  }
-  bn -= NDIRECT;// -11 表示 bn从第11开始
-  
-  // a singly-indirect block
-  if(bn < NINDIRECT) {// [0, 255]
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
+      addr = balloc(ip->dev, ORDERED(ip), ip->inum);
       if(addr == 0)
         return 0;
-      ip->addrs[NDIRECT] = addr;
-    }
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
-      if(addr){
-        a[bn] = addr;
-        log_write(bp);
-      }
+      ip->addrs[bn] = addr;
     }
-    brelse(bp);
     return addr;
   }
 
-
-  // 下面逻辑处理 double-indirect block
-  bn -= NINDIRECT; // bn - 255即 从256开始算转换后为0  [0, 10] [11, 11+255] [11+255, 11+255+255*255]
-  if(bn < NINDIRECT * NINDIRECT){// [0, 256*256-1] not is 256*256      对于3*3二维数组是0~8
-    // bn = 300  = 255 +45
-    // 第一层 0 第二层 0 ~ 255 [0,   255]
-    // 第一层 1 第二层 0 ~ 255 [256, 511]
-    // 第一层 2 第二层 0 ~ 255 [512, 767]
-    // 第一层 3 第二层 0 ~ 255 [768, 1023]
-    // ...
-
-    uint first_bn = bn / NINDIRECT;
-    uint second_bn = bn % NINDIRECT;
-    
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT+1]) == 0){// ip->addrs[NDIRECT] 是第一层的indirect
-      addr = balloc(ip->dev);// balloc是由底层的bget操作保证原子性的
-      if(addr == 0)
-        return 0;
-      ip->addrs[NDIRECT+1] = addr;
-    }
-    // 第一层indirect block
+  level = blevel(bn, &rem, &first);
+  // Load the top indirect block, allocating if necessary.
+  if((addr = ip->addrs[NDIRECT+level-1]) == 0){
+    if(!alloc)
+      return 0;
+    addr = balloc(ip->dev, 0, ip->inum);
+    if(addr == 0)
+      return 0;
+    ip->addrs[NDIRECT+level-1] = addr;
+  }
+  // walk down, one indirect block per level.
+  for(k = level; k > 0; k--){
+    idx = rem / bspan(k);
+    rem %= bspan(k);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr1 = a[first_bn]) == 0){
-      addr1 = balloc(ip->dev);
-      if(addr1){
-        a[first_bn] = addr1;
-        log_write(bp);
+    if((next = a[idx]) == 0 && alloc){
+      next = balloc(ip->dev, k == 1 ? ORDERED(ip) : 0, ip->inum);
+      if(next){
+        a[idx] = next;
+        log_write_range(bp, idx*sizeof(uint), sizeof(uint));
       }
     }
     brelse(bp);// Don't forget to brelse() each block that you bread().
+    if(next == 0)
+      return 0;
+    addr = next;
+  }
+  return addr;
+}
 
-    // 第二层indirect block
-    bp = bread(ip->dev, addr1);
-    a = (uint*)bp->data;
-    if((addr2 = a[second_bn]) == 0){
-      addr2 = balloc(ip->dev);
-      if(addr2){
-        a[second_bn] = addr2;
-        log_write(bp);
-      }
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one if alloc is
+// set, and otherwise returns 0: the block is a hole.
+// returns 0 if out of disk space.
+static uint
+bmap(struct inode *ip, uint bn, int alloc)
+{
+  struct bmrun *r;
+  uint addr;
+
+  if(bn < NDIRECT)
+    return bwalk(ip, bn, alloc);
+  for(r = ip->bmc; r < &ip->bmc[NBMRUN]; r++){
+    if(r->n && bn >= r->bn && bn < r->bn + r->n)
+      return r->addr + (bn - r->bn);
+  }
+  if((addr = bwalk(ip, bn, alloc)) == 0)
+    return 0;
+  // extend the run this block continues, or start a new one.
+  for(r = ip->bmc; r < &ip->bmc[NBMRUN]; r++){
+    if(r->n && bn == r->bn + r->n && addr == r->addr + r->n){
+      r->n++;
+      return addr;
     }
-    brelse(bp);// Don't forget to brelse() each block that you bread().
-    return addr2;
   }
+  r = &ip->bmc[ip->bmnext];
+  ip->bmnext = (ip->bmnext + 1) % NBMRUN;
+  r->bn = bn;
+  r->addr = addr;
+  r->n = 1;
+  return addr;
+}
 
-  panic("bmap: out of range");
+// Forget ip's cached block runs.
+static void
+bmflush(struct inode *ip)
+{
+  memset(ip->bmc, 0, sizeof(ip->bmc));
+  ip->bmnext = 0;
+}
+
+// Free indirect block addr, k levels above the data,
+// and all the blocks under it.
+static void
+bfreeind(uint dev, uint addr, int k)
+{
+  struct buf *bp;
+  uint *a;
+  int i;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(i = 0; i < NINDIRECT; i++){
+    if(a[i] == 0)
+      continue;
+    if(k > 1)
+      bfreeind(dev, a[i], k - 1);
+    else
+      bfree(dev, a[i]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
 }
 
 // Truncate inode (discard contents).
@@ -479,9 +723,17 @@ bmap(struct inode *ip, uint bn)
 void
 itrunc(struct inode *ip)
 {
-  int i, j, m, n;
-  struct buf *bp, *bp1, *bp2;
-  uint *a, *b;
+  int i;
+
+  bmflush(ip);
+  if(ip->type == T_SYMLINK)
+    symforget(ip);
+  if(ip->flags & DI_INLINE){
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -490,43 +742,207 @@ itrunc(struct inode *ip)
     }
   }
 
-  // singly-indirect block
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  // singly-, doubly- and triply-indirect blocks
+  for(i = 0; i < NLEVEL; i++){
+    if(ip->addrs[NDIRECT+i]){
+      bfreeind(ip->dev, ip->addrs[NDIRECT+i], i + 1);
+      ip->addrs[NDIRECT+i] = 0;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
-  }
-
-  // doubly-indirect block free
-  if(ip->addrs[NDIRECT+1]){
-    bp1 = bread(ip->dev, ip->addrs[NDIRECT+1]); // read first indirect block
-    a = (uint*)bp1->data;
-    for(m = 0; m < NINDIRECT; m++){
-      if(a[m]){
-        bp2 = bread(ip->dev, a[m]); // read second indirect block
-        b = (uint*)bp2->data;
-        for(n = 0; n < NINDIRECT; n++){
-          if(b[n]){
-            bfree(ip->dev, b[n]); // free data block
-          }
+  }
+
+  ip->size = 0;
+  if(ip->type == T_FILE || ip->type == T_SYMLINK)
+    ip->flags |= DI_INLINE;  // empty again; start over inline
+  iupdate(ip);
+}
+
+#define TRUNCBATCH 4096  // most blocks one itrunc_some() frees
+
+// Free a block for itrunc_some(), counting in *cost the
+// bitmap blocks it may have added to the transaction.
+static void
+tfree(struct inode *ip, uint b, uint *lastbb, int *cost)
+{
+  bfree(ip->dev, b);
+  if(BBLOCK(b, sb) != *lastbb){
+    *lastbb = BBLOCK(b, sb);
+    (*cost)++;
+  }
+}
+
+// Clear entry i of indirect block bp for itrunc_some().
+static void
+tclear(struct buf *bp, uint i, uint *lastind, int *cost)
+{
+  ((uint*)bp->data)[i] = 0;
+  log_write_range(bp, i*sizeof(uint), sizeof(uint));
+  if(bp->blockno != *lastind){
+    *lastind = bp->blockno;
+    (*cost)++;
+  }
+}
+
+// Free the last blocks of ip, as many as fit in one
+// transaction (at most TRUNCBATCH), shrinking ip->size
+// to match, and the indirect blocks that empties. A missing
+// indirect block is skipped over as a whole.
+// Returns 1 once ip is empty.
+// Caller must hold ip->lock and be in a transaction.
+static int
+itrunc_some(struct inode *ip)
+{
+  uint last, rem, first, lastbb, lastind, *a;
+  uint path[NLEVEL], idx[NLEVEL], base[NLEVEL];
+  struct buf *bp;
+  int n, k, level, cost;
+
+  bmflush(ip);
+  lastbb = lastind = 0;
+  cost = 2;  // the inode and the orphan table
+  // a step touches at most NLEVEL+1 bitmap blocks and two
+  // indirect blocks.
+  for(n = 0; ip->size > 0 && n < TRUNCBATCH && cost + NLEVEL + 3 <= MAXOPBLOCKS; n++){
+    last = (ip->size - 1) / BSIZE;
+    if(last < NDIRECT){
+      if(ip->addrs[last]){
+        tfree(ip, ip->addrs[last], &lastbb, &cost);
+        ip->addrs[last] = 0;
+      }
+      ip->size = (uint64)last * BSIZE;
+      continue;
+    }
+
+    // the indirect blocks on the way to block last: path[k]
+    // is at depth k, entry idx[k] of it leads on, and the
+    // first block under it is base[k].
+    level = blevel(last, &rem, &first);
+    memset(path, 0, sizeof(path));
+    path[0] = ip->addrs[NDIRECT+level-1];
+    base[0] = first;
+    for(k = 0; k < level; k++){
+      idx[k] = rem / bspan(level - k);
+      rem %= bspan(level - k);
+      if(k + 1 < level){
+        base[k+1] = base[k] + idx[k] * bspan(level - k);
+        if(path[k]){
+          bp = bread(ip->dev, path[k]);
+          path[k+1] = ((uint*)bp->data)[idx[k]];
+          brelse(bp);
         }
-        brelse(bp2);
-        bfree(ip->dev, a[m]);
       }
     }
-    brelse(bp1);
-    bfree(ip->dev, ip->addrs[NDIRECT+1]);
-    ip->addrs[NDIRECT+1] = 0;
-  }
 
-  ip->size = 0;
+    for(k = 0; k < level && path[k]; k++)
+      ;
+    if(k < level){
+      // a hole where an indirect block would be: skip it all.
+      ip->size = (uint64)base[k] * BSIZE;
+      k--;
+    } else {
+      // the data block.
+      bp = bread(ip->dev, path[level-1]);
+      a = (uint*)bp->data;
+      if(a[idx[level-1]]){
+        tfree(ip, a[idx[level-1]], &lastbb, &cost);
+        if(idx[level-1] > 0)
+          tclear(bp, idx[level-1], &lastind, &cost);
+      }
+      brelse(bp);
+      ip->size = (uint64)last * BSIZE;
+      k = level - 1;
+    }
+
+    // free the indirect blocks above that are now empty,
+    // and clear the entry of the first one that isn't.
+    for(; k >= 0 && idx[k] == 0; k--){
+      tfree(ip, path[k], &lastbb, &cost);
+      if(k == 0){
+        ip->addrs[NDIRECT+level-1] = 0;
+      } else if(idx[k-1] > 0){
+        bp = bread(ip->dev, path[k-1]);
+        tclear(bp, idx[k-1], &lastind, &cost);
+        brelse(bp);
+      }
+    }
+  }
   iupdate(ip);
+  return ip->size == 0;
+}
+
+// Record in the orphan table that inum's blocks are to be
+// freed by the reclaimer. Returns 0 if the table is full.
+// Must be called within a transaction.
+static int
+orphan_add(uint dev, uint inum)
+{
+  struct buf *bp;
+  uint *a;
+  int i;
+
+  bp = bread(dev, 1);
+  a = (uint*)(bp->data + ORPHANOFF);
+  for(i = 0; i < NORPHAN; i++){
+    if(a[i] == 0){
+      a[i] = inum;
+      log_write_range(bp, ORPHANOFF + i*sizeof(uint), sizeof(uint));
+      brelse(bp);
+      acquire(&orphans.lock);
+      orphans.n++;
+      wakeup(&orphans);
+      release(&orphans.lock);
+      return 1;
+    }
+  }
+  brelse(bp);
+  return 0;
+}
+
+// Kernel thread that frees the blocks of unlinked files in
+// the orphan table, a transaction at a time, and then the
+// inodes themselves.
+static void
+reclaimer(void)
+{
+  struct inode *ip;
+  struct buf *bp;
+  uint *a, inum;
+  int i, done;
+
+  for(;;){
+    acquire(&orphans.lock);
+    while(orphans.n == 0)
+      sleep(&orphans, &orphans.lock);
+    release(&orphans.lock);
+
+    bp = bread(ROOTDEV, 1);
+    a = (uint*)(bp->data + ORPHANOFF);
+    for(i = 0; i < NORPHAN && a[i] == 0; i++)
+      ;
+    inum = i < NORPHAN ? a[i] : 0;
+    brelse(bp);
+    if(inum == 0)
+      panic("reclaimer");
+
+    ip = iget(ROOTDEV, inum);
+    do {
+      begin_op();
+      ilock(ip);
+      done = itrunc_some(ip);
+      iunlock(ip);
+      if(done){
+        bp = bread(ROOTDEV, 1);
+        ((uint*)(bp->data + ORPHANOFF))[i] = 0;
+        log_write_range(bp, ORPHANOFF + i*sizeof(uint), sizeof(uint));
+        brelse(bp);
+        iput(ip);  // frees the inode
+      }
+      end_op();
+    } while(!done);
+
+    acquire(&orphans.lock);
+    orphans.n--;
+    release(&orphans.lock);
+  }
 }
 
 // Copy stat information from inode.
@@ -541,12 +957,48 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+static char zeros[BSIZE];  // what holes read as
+
+// Move ip's inline data out to its first block, ahead of a
+// write that doesn't fit in addrs[]. Returns -1 if out of
+// disk space, leaving ip inline.
+// Caller must hold ip->lock and be in a transaction.
+static int
+iexpand(struct inode *ip)
+{
+  char data[INLINESIZE];
+  struct buf *bp;
+  uint addr;
+
+  memmove(data, ip->addrs, sizeof(data));
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->flags &= ~DI_INLINE;
+  if(ip->size > 0){
+    if((addr = bmap(ip, 0, 1)) == 0){
+      memmove(ip->addrs, data, sizeof(data));
+      ip->flags |= DI_INLINE;
+      return -1;
+    }
+    bp = bfresh(ip->dev, addr);
+    memset(bp->data, 0, BSIZE);
+    memmove(bp->data, data, ip->size);
+    bp->valid = 1;
+    if(ORDERED(ip))
+      log_write_data(bp);
+    else
+      log_write(bp);
+    brelse(bp);
+  }
+  iupdate(ip);
+  return 0;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
-readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+readi(struct inode *ip, int user_dst, uint64 dst, uint64 off, uint n)
 {
   uint tot, m;
   struct buf *bp;
@@ -556,12 +1008,23 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(ip->flags & DI_INLINE){
+    if(either_copyout(user_dst, dst, (char*)ip->addrs + off, n) == -1)
+      return -1;
+    return n;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    uint addr = bmap(ip, off/BSIZE);
-    if(addr == 0)
-      break;
-    bp = bread(ip->dev, addr);
+    uint addr = bmap(ip, off/BSIZE, 0);
     m = min(n - tot, BSIZE - off%BSIZE);
+    if(addr == 0){  // a hole
+      if(either_copyout(user_dst, dst, zeros, m) == -1) {
+        tot = -1;
+        break;
+      }
+      continue;
+    }
+    bp = bread(ip->dev, addr);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
       tot = -1;
@@ -580,27 +1043,51 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 // If the return value is less than the requested n,
 // there was an error of some kind.
 int
-writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+writei(struct inode *ip, int user_src, uint64 src, uint64 off, uint n)
 {
   uint tot, m;
   struct buf *bp;
 
-  if(off > ip->size || off + n < off)
+  // writing past the end leaves a hole, which
+  // takes no blocks until written.
+  if(off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->type == T_SYMLINK)
+    symforget(ip);
+
+  if(ip->flags & DI_INLINE){
+    if(off + n <= INLINESIZE){
+      if(either_copyin((char*)ip->addrs + off, user_src, src, n) == -1)
+        return -1;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    if(iexpand(ip) < 0)
+      return -1;
+  }
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    uint addr = bmap(ip, off/BSIZE);
+    uint addr = bmap(ip, off/BSIZE, 1);
     if(addr == 0)
       break;
-    bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
+    if(m == BSIZE)
+      bp = bfresh(ip->dev, addr);  // no need to read what we overwrite
+    else
+      bp = bread(ip->dev, addr);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       break;
     }
-    log_write(bp);
+    bp->valid = 1;
+    if(ORDERED(ip))
+      log_write_data(bp);
+    else
+      log_write_range(bp, off % BSIZE, m);
     brelse(bp);
   }
 
@@ -682,6 +1169,47 @@ dirlink(struct inode *dp, char *name, uint inum)
   return 0;
 }
 
+// Read up to n entries of directory dp into d, starting at
+// byte *off and skipping empty slots, and advance *off past
+// them. If plus is set, also fill in each entry's type, link
+// count and size, from its dinode in the buffer cache, which
+// every inode change is written to at once. Returns the
+// number of entries, or -1 if dp isn't a directory.
+int
+dirread(struct inode *dp, uint64 *off, struct direntplus *d, int n, int plus)
+{
+  struct dirent de;
+  struct dinode *dip;
+  struct buf *bp;
+  int k;
+
+  ilock(dp);
+  if(dp->type != T_DIR){
+    iunlock(dp);
+    return -1;
+  }
+  for(k = 0; k < n && *off < dp->size; *off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, *off, sizeof(de)) != sizeof(de))
+      panic("dirread");
+    if(de.inum == 0)
+      continue;
+    memset(&d[k], 0, sizeof(d[k]));
+    d[k].ino = de.inum;
+    memmove(d[k].name, de.name, DIRSIZ);
+    if(plus){
+      bp = bread(dp->dev, IBLOCK(de.inum, sb));
+      dip = (struct dinode*)bp->data + de.inum%IPB;
+      d[k].type = dip->type;
+      d[k].nlink = dip->nlink;
+      d[k].size = dip->size;
+      brelse(bp);
+    }
+    k++;
+  }
+  iunlock(dp);
+  return k;
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -725,17 +1253,72 @@ skipelem(char *path, char *name)
   return path;
 }
 
-// Look up and return the inode for a path name.
+// Forget any cached target of ip, whose contents are
+// changing or which is being freed.
+static void
+symforget(struct inode *ip)
+{
+  int i;
+
+  acquire(&symcache.lock);
+  for(i = 0; i < NSYMCACHE; i++)
+    if(symcache.e[i].inum == ip->inum && symcache.e[i].dev == ip->dev)
+      symcache.e[i].inum = 0;
+  release(&symcache.lock);
+}
+
+// Copy the target of symbolic link ip to dst, which has
+// room for ip->size bytes. Returns -1 on error.
+// Caller must hold ip->lock.
+static int
+readlink(struct inode *ip, char *dst)
+{
+  int i;
+
+  if(ip->flags & DI_INLINE)
+    return readi(ip, 0, (uint64)dst, 0, ip->size) == ip->size ? 0 : -1;
+  acquire(&symcache.lock);
+  for(i = 0; i < NSYMCACHE; i++){
+    if(symcache.e[i].inum == ip->inum && symcache.e[i].dev == ip->dev){
+      memmove(dst, symcache.e[i].target, ip->size);
+      release(&symcache.lock);
+      return 0;
+    }
+  }
+  release(&symcache.lock);
+  if(readi(ip, 0, (uint64)dst, 0, ip->size) != ip->size)
+    return -1;
+  acquire(&symcache.lock);
+  i = symcache.next;
+  symcache.next = (i + 1) % NSYMCACHE;
+  symcache.e[i].dev = ip->dev;
+  symcache.e[i].inum = ip->inum;
+  memmove(symcache.e[i].target, dst, ip->size);
+  release(&symcache.lock);
+  return 0;
+}
+
+// Look up and return the inode for a path name, relative to
+// directory dp, or to the current directory if dp is 0.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// Symbolic links are followed wherever they appear, except as
+// the final element when follow is 0; a relative target is
+// looked up from the directory holding the link.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(struct inode *dp, char *path, int nameiparent, int follow, char *name)
 {
   struct inode *ip, *next;
+  char buf[MAXPATH];
+  int nlinks, n, r;
+
+  nlinks = 0;
   // 决定从哪里开始找，如果有'/'就从根目录开始，否则从当前目录开始
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
+  else if(dp)
+    ip = idup(dp);
   else
     ip = idup(myproc()->cwd); // 当前目录的inode
 
@@ -765,7 +1348,36 @@ namex(char *path, int nameiparent, char *name)
       iunlockput(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlock(ip);
+    if(*path != '\0' || follow){
+      ilock(next);
+      if(next->type == T_SYMLINK){
+        // continue with the target, then the rest of the path.
+        n = next->size;
+        r = strlen(path);
+        if(++nlinks > MAXSYMLINKS || n == 0 || n + 1 + r >= MAXPATH){
+          iunlockput(next);
+          iput(ip);
+          return 0;
+        }
+        memmove(buf + n + 1, path, r + 1);
+        if(readlink(next, buf) < 0){
+          iunlockput(next);
+          iput(ip);
+          return 0;
+        }
+        buf[n] = r ? '/' : '\0';
+        iunlockput(next);
+        path = buf;
+        if(*path == '/'){
+          iput(ip);
+          ip = iget(ROOTDEV, ROOTINO);
+        }
+        continue;
+      }
+      iunlock(next);
+    }
+    iput(ip);
     ip = next;
   }
   if(nameiparent){
@@ -788,7 +1400,16 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(0, path, 0, 1, name);
+}
+
+// Like namei(), but if the final element of path is a
+// symbolic link, return the link itself.
+struct inode*
+nameilink(char *path)
+{
+  char name[DIRSIZ];
+  return namex(0, path, 0, 0, name);
 }
 
 
@@ -796,5 +1417,20 @@ namei(char *path)
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(0, path, 1, 0, name);
+}
+
+// Like namei() and nameilink(), but a relative path starts
+// from directory dp instead of the current directory.
+struct inode*
+nameiat(struct inode *dp, char *path, int follow)
+{
+  char name[DIRSIZ];
+  return namex(dp, path, 0, follow, name);
+}
+
+struct inode*
+nameiparentat(struct inode *dp, char *path, char *name)
+{
+  return namex(dp, path, 1, 0, name);
 }
@@ -3,12 +3,24 @@
 
 
 #define ROOTINO  1   // root i-number
+#ifndef BSIZE
 #define BSIZE 1024  // block size
+#endif
+// buffers are carved out of pages, and a block is whole sectors.
+#if BSIZE != 1024 && BSIZE != 2048 && BSIZE != 4096
+#error "BSIZE must be 1024, 2048 or 4096"
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
 //                                          free bit map | data blocks]
 //
+// or, if the super block's ngroups is not 0, with the rest of
+// the disk after the log divided into block groups of
+// groupsize blocks, each laid out as
+// [ free bit map block | ginodes inodes | data blocks ]
+// so that files can be kept near their inodes.
+//
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
 struct superblock {
@@ -20,44 +32,77 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint ngroups;      // Number of block groups, 0 for the flat layout
+  uint groupstart;   // Block number of the first group
+  uint groupsize;    // Blocks per group, at most BPB
+  uint ginodes;      // Inodes per group, a multiple of IPB
+  uint bsize;        // Block size; 0 means 1024
 };
 
 #define FSMAGIC 0x10203040
 
+// Inodes that were unlinked while they still held many blocks,
+// and whose blocks the reclaimer has yet to free, are listed
+// at the end of the superblock's block. 0 marks a free slot.
+#define NORPHAN 32
+#define ORPHANOFF (BSIZE - NORPHAN*sizeof(uint))
+
 // #define NDIRECT 12
 
-// The first 11 elements of ip->addrs[] should be direct blocks; 
-// the 12th should be a singly-indirect block (just like the current one); 
-// the 13th should be your new doubly-indirect block.
-// 11 direct blocks + 1 singly-indirect block + 1 doubly-indirect block
-// 256*256+256+11 blocks 注意细节呀 不是 256*256+11 !!!
-// 这里的12 应该改为11 后面的 uint addrs[NDIRECT+1] 改为 uint addrs[NDIRECT+2]更为合理
-#define NDIRECT 11
+// The first 9 elements of ip->addrs[] are direct blocks;
+// the 10th is a singly-indirect block, the 11th a
+// doubly-indirect block and the 12th a triply-indirect block.
+// 9 + 256 + 256*256 + 256*256*256 blocks, a little over 16 GB.
+#define NDIRECT 9
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT + NINDIRECT*NINDIRECT)
+#define NLEVEL 3   // indirect block pointers in addrs[]
+#define MAXFILE (NDIRECT + NINDIRECT + NINDIRECT*NINDIRECT + \
+                 NINDIRECT*NINDIRECT*NINDIRECT)
 
 // dinode是磁盘的存储形式 inode是内存的存储形式
 // On-disk inode structure 64byte = 8 + 4 + 52
 struct dinode {
   short type;           // File type
-  short major;          // Major device number (T_DEVICE only)
-  short minor;          // Minor device number (T_DEVICE only)
+  uchar major;          // Major device number (T_DEVICE only)
+  uchar minor;          // Minor device number (T_DEVICE only)
+  short flags;          // DI_ flags
   short nlink;          // Number of links to inode in file system
-  uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+2];   // Data block addresses   11 direct blocks + 1 singly-indirect block + 1 doubly-indirect block
+  uint64 size;          // Size of file (bytes)
+  uint addrs[NDIRECT+NLEVEL];   // Data block addresses: 9 direct blocks + singly-, doubly- and triply-indirect blocks
 };
 
+// dinode flags
+#define DI_INLINE 0x1   // the data is in addrs[], not in blocks
+
+// Files and symbolic links start out inline, and move
+// their data to a block when it outgrows addrs[].
+#define INLINESIZE ((NDIRECT+NLEVEL) * sizeof(uint))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
+// First block of group g
+#define GSTART(g, sb)     (sb.groupstart + (g)*sb.groupsize)
+
+// Group holding inode i, and block b
+#define IGROUP(i, sb)     ((i) / sb.ginodes)
+#define BGROUP(b, sb)     (((b) - sb.groupstart) / sb.groupsize)
+
 // Block containing inode i
-#define IBLOCK(i, sb)     ((i) / IPB + sb.inodestart)
+#define IBLOCK(i, sb)     (sb.ngroups ? \
+  GSTART(IGROUP(i, sb), sb) + 1 + (i) % sb.ginodes / IPB : \
+  (i) / IPB + sb.inodestart)
 
 // Bitmap bits per block
 #define BPB           (BSIZE*8)
 
 // Block of free map containing bit for block b
-#define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
+#define BBLOCK(b, sb) (sb.ngroups ? GSTART(BGROUP(b, sb), sb) : \
+  (b)/BPB + sb.bmapstart)
+
+// Bit for block b in its free map block
+#define BOFF(b, sb)   (sb.ngroups ? ((b) - sb.groupstart) % sb.groupsize : \
+  (b) % BPB)
 
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
@@ -67,3 +112,13 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory entry as getdents() returns it. type, nlink
+// and size are 0 unless getdents() was asked for them.
+struct direntplus {
+  uint ino;
+  short type;
+  short nlink;
+  uint64 size;
+  char name[DIRSIZ+1];  // 0-terminated
+};
+
@@ -0,0 +1,43 @@
+// Block I/O statistics, shared by the kernel and user/iostat.c.
+
+// buffer cache replacement policies, for bcachepolicy().
+#define BLRU 0  // one LRU list
+#define B2Q  1  // scan-resistant 2Q (default)
+
+struct bcachestat {
+  uint64 hits;       // bget() found the block cached
+  uint64 misses;     // bget() had to give the block a buffer
+  uint64 evictions;  // cached blocks dropped to make room
+  uint64 writes;     // bwrite() calls
+  uint64 noreads;    // bfresh() misses, which skipped a disk read
+  uint64 metahits;   // hits on blocks up to the end of the free bitmap
+  uint64 metamisses; // misses on those blocks
+  int dirty;         // buffers pinned by the log, not yet installed
+  int nbuf;          // buffers in the cache
+  int target;        // size the cache grows back to
+  int grows;         // groups of buffers allocated
+  int shrinks;       // groups given back under memory pressure
+  int na1;           // buffers on the 2Q A1 (seen once) list
+  int policy;        // BLRU or B2Q
+};
+
+// disk request latency histogram buckets: bucket i counts
+// requests that took [2^i, 2^(i+1)) microseconds, except
+// that bucket 0 starts at 0 and the last has no upper end.
+#define NDISKLAT 16
+
+struct diskstat {
+  uint64 reqs;       // requests submitted
+  uint64 blocks;     // blocks those requests moved
+  uint64 kicks;      // QUEUE_NOTIFY writes
+  uint64 intrs;      // disk interrupts
+  uint64 polled;     // requests whose completion a poller reaped
+  uint64 slept;      // requests the interrupt handler reaped
+  uint64 lat[2][NDISKLAT]; // latency histograms, [polled][bucket]
+  uint64 merged;     // blocks merged into a neighbour's request
+  uint64 expired;    // requests served early for their deadline
+  int queued;        // requests waiting in the elevator
+  int poll;          // microseconds to poll, 0 for interrupts only
+  int qsize;         // virtqueue size
+  int eventidx;      // using event-index notification suppression?
+};
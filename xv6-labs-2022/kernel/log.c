@@ -3,6 +3,7 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -17,131 +18,408 @@
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
+// the count of in-progress FS system calls and reserves
+// MAXOPBLOCKS of log space; begin_opn(n, nd) reserves only n,
+// and nd slots on the ordered list described below.
+// But if the reservations might overrun the log, it
 // sleeps until the last outstanding end_op() commits.
 //
-// The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
-
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+// The log is a physical re-do log of changes to disk blocks.
+// After its first block, which records where the oldest
+// transaction still needed starts and its sequence number,
+// the log is a circular buffer of committed transactions:
+//   descriptor blocks: magic, seq, n, and for each of
+//     blocks A, B, C, ...: block #, offset, length
+//   the modified bytes of A, then of B, then of C, ...,
+//     packed end to end across as many blocks as needed
+//   commit block: magic, seq, n
+// Each logged block records just the range of bytes changed
+// in the transaction, as log_write_range() reports them;
+// log_write() logs the whole block. Recovery and the
+// checkpoint apply the ranges to the home blocks on disk.
+// A transaction commits when its commit block is on disk,
+// which is when end_op() returns. Installing committed
+// blocks in their home locations ("checkpointing") is left
+// to the checkpointer kernel thread, which runs once the
+// log is half full; commit() does it only when it needs
+// the space. Until a block is checkpointed its buffer stays
+// pinned in the cache, and checkpointing copies the logged
+// version, not the buffer, which may hold newer changes.
+// Recovery replays transactions from the recorded start for
+// as long as it finds descriptors and commit blocks with
+// consecutive sequence numbers.
+//
+// Ordinary file data is not logged. log_write_data() instead
+// adds a data block to the transaction's ordered list, and
+// commit() writes those blocks in place before it writes
+// the commit block, so committed metadata never points at
+// data that did not reach the disk. An op that writes file
+// data reserves slots on the list in begin_opn(), as it does
+// log blocks, so the list can't fill up. A crash before the commit can
+// leave new data in blocks that the old, still committed
+// metadata owns, as in other ordered-mode journals. A block
+// still waiting to be checkpointed as metadata is checkpointed
+// before its data is written in place, so that the checkpoint
+// can't overwrite it with its old contents.
+
+#define LOGMAGIC  0x6c6f6721  // first block of the log
+#define LOGDESC   0x6c6f6744  // descriptor block
+#define LOGCOMMIT 0x6c6f6743  // commit block
+
+#define NTRANS    128  // committed transactions awaiting checkpoint
+#define NSHADOW   64   // home blocks a checkpoint writes at once
+
+// The running transaction's block #s, and the range
+// of bytes [lo, hi) modified in each.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int block[MAXLOGSIZE];
+  int lo[MAXLOGSIZE];
+  int hi[MAXLOGSIZE];
 };
 
+#define LHPB ((int)(BSIZE / sizeof(int)))  // descriptor ints per block
+#define DESCHDR 3  // magic, seq and n ahead of the entries
+#define DESCENT 3  // block #, offset and length per entry
+// descriptor blocks for a transaction of n blocks.
+#define NDESC(n) (((n)*DESCENT + DESCHDR + LHPB - 1) / LHPB)
+// blocks holding nbytes of modified bytes.
+#define NDATA(nbytes) (((nbytes) + BSIZE - 1) / BSIZE)
+// disk block holding position pos of the circular log.
+#define LOGBLOCK(pos) (log.start + 1 + (pos) % log.area)
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int area;        // blocks in the circular part
+  int cap;         // max blocks in a transaction
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks reserved by outstanding calls
+  int dreserved;   // ordered list slots reserved by them
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
+  int ndata;       // blocks in data[]
+  int data[NORDERED]; // ordered data blocks of this transaction
+  // positions count blocks written to the circular part.
+  uint64 head;     // where the next transaction goes
+  uint64 tail;     // start of the oldest transaction not checkpointed
+  uint seq;        // sequence number of the next transaction
+  struct {
+    uint64 pos;
+    uint seq;
+  } trans[NTRANS]; // committed transactions, oldest at t0
+  int t0;
+  int nt;
+  struct sleeplock ckptlock; // one checkpoint at a time
 };
 struct log log;
 
+// bufs being written by commit() or recovery,
+// which run one at a time.
+static struct buf *iobuf[MAXLOGSIZE + NDESC(MAXLOGSIZE)];
+
+// a transaction's descriptor entries, as read back by
+// recovery or checkpoint(), which run one at a time.
+static int cpblock[MAXLOGSIZE];
+static int cpoff[MAXLOGSIZE];
+static int cplen[MAXLOGSIZE];
+
+// checkpoint()'s copies of home blocks, outside the cache.
+static struct buf shadow[NSHADOW];
+static uchar shadowdata[NSHADOW][BSIZE];
+
 static void recover_from_log(void);
 static void commit();
+static int undata(uint);
+static void checkpointer(void);
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
-
   initlock(&log.lock, "log");
+  initsleeplock(&log.ckptlock, "checkpoint");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  log.area = log.size - 1;
+  // leave room for a transaction's descriptor and commit blocks.
+  log.cap = log.area - 1 - NDESC(log.area);
+  if (log.cap > MAXLOGSIZE)
+    log.cap = MAXLOGSIZE;
+  if (log.cap < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
   recover_from_log();
+  kproc(checkpointer, "checkpoint");
 }
 
-// Copy committed blocks from log to their home location
+// Record in the log's first block where the oldest
+// transaction still needed starts, and its seq.
 static void
-install_trans(int recovering)
+write_super(uint64 tail, uint seq)
 {
-  int tail;
+  struct buf *buf = bfresh(log.dev, log.start);
+  int *a = (int *) (buf->data);
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+  memset(buf->data, 0, BSIZE);
+  a[0] = LOGMAGIC;
+  a[1] = tail % log.area;
+  a[2] = seq;
+  buf->valid = 1;
+  bwrite(buf);
+  brelse(buf);
 }
 
-// Read the log header from disk into the in-memory log header
-static void
-read_head(void)
+// Read the descriptor at pos into cpblock[], cpoff[] and
+// cplen[]. Returns the number of entries, or -1 if pos
+// doesn't hold transaction seq's descriptor. *nbytes is
+// set to the total length of the modified bytes.
+static int
+read_desc(uint64 pos, uint seq, int *nbytes)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  struct buf *buf = bread(log.dev, LOGBLOCK(pos));
+  int *a = (int *) (buf->data);
+  int i, j, n, v;
+
+  n = a[2];
+  if (a[0] != LOGDESC || (uint)a[1] != seq || n < 1 || n > log.cap) {
+    brelse(buf);
+    return -1;
   }
+  *nbytes = 0;
+  for (i = 0; i < n*DESCENT; i++) {
+    j = i + DESCHDR;
+    if (j % LHPB == 0) {  // next descriptor block
+      brelse(buf);
+      buf = bread(log.dev, LOGBLOCK(pos + j / LHPB));
+      a = (int *) (buf->data);
+    }
+    v = a[j % LHPB];
+    if (i % DESCENT == 0)
+      cpblock[i / DESCENT] = v;
+    else if (i % DESCENT == 1)
+      cpoff[i / DESCENT] = v;
+    else
+      cplen[i / DESCENT] = v;
+  }
+  brelse(buf);
+  for (i = 0; i < n; i++) {
+    if (cpoff[i] < 0 || cplen[i] < 1 || cpoff[i] + cplen[i] > BSIZE)
+      return -1;
+    *nbytes += cplen[i];
+  }
+  return n;
+}
+
+// Does transaction seq, of n entries and nbytes at pos,
+// have its commit block?
+static int
+committed(uint64 pos, uint seq, int n, int nbytes)
+{
+  struct buf *buf = bread(log.dev, LOGBLOCK(pos + NDESC(n) + NDATA(nbytes)));
+  int *a = (int *) (buf->data);
+  int ok;
+
+  ok = a[0] == LOGCOMMIT && (uint)a[1] == seq && a[2] == n;
   brelse(buf);
+  return ok;
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Copy len modified bytes, starting off bytes into the
+// packed data of the transaction of n entries at pos, to dst.
 static void
-write_head(void)
+read_bytes(uint64 pos, int n, int off, uchar *dst, int len)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  struct buf *buf;
+  int m;
+
+  while (len > 0) {
+    buf = bread(log.dev, LOGBLOCK(pos + NDESC(n) + off / BSIZE));
+    m = BSIZE - off % BSIZE;
+    if (m > len)
+      m = len;
+    memmove(dst, buf->data + off % BSIZE, m);
+    brelse(buf);
+    dst += m;
+    off += m;
+    len -= m;
   }
-  bwrite(buf);
-  brelse(buf);
 }
 
+// Replay committed transactions after a crash.
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct buf *buf;
+  uint64 pos;
+  uint seq;
+  int *a, i, n, off, nbytes;
+
+  buf = bread(log.dev, log.start);
+  a = (int *) (buf->data);
+  if (a[0] == LOGMAGIC) {
+    pos = a[1];
+    seq = a[2];
+    brelse(buf);
+  } else {
+    // a new log; make sure nothing at its start looks
+    // like a transaction.
+    brelse(buf);
+    pos = 0;
+    seq = 1;
+    buf = bfresh(log.dev, LOGBLOCK(pos));
+    memset(buf->data, 0, BSIZE);
+    buf->valid = 1;
+    bwrite(buf);
+    brelse(buf);
+  }
+
+  while ((n = read_desc(pos, seq, &nbytes)) > 0 && committed(pos, seq, n, nbytes)) {
+    off = 0;
+    for (i = 0; i < n; i++) {
+      struct buf *dbuf = bread(log.dev, cpblock[i]); // read dst
+      read_bytes(pos, n, off, dbuf->data + cpoff[i], cplen[i]);
+      bwrite(dbuf);  // write dst to disk
+      brelse(dbuf);
+      off += cplen[i];
+    }
+    pos += NDESC(n) + NDATA(nbytes) + 1;
+    seq++;
+  }
+
+  log.head = log.tail = pos;
+  log.seq = seq;
+  write_super(pos, seq); // forget the replayed transactions
+}
+
+// Install the oldest k committed transactions (or all, if
+// fewer) in their home locations, then free their log space.
+static void
+checkpoint(int k)
+{
+  uint64 pos, tail;
+  uint seq;
+  int i, j, m, n, off, nbytes, done;
+
+  acquiresleep(&log.ckptlock);
+  tail = 0;
+  seq = 0;
+  for (done = 0; done < k; done++) {
+    acquire(&log.lock);
+    if (done >= log.nt) {
+      release(&log.lock);
+      break;
+    }
+    pos = log.trans[(log.t0 + done) % NTRANS].pos;
+    seq = log.trans[(log.t0 + done) % NTRANS].seq;
+    release(&log.lock);
+
+    if ((n = read_desc(pos, seq, &nbytes)) < 0)
+      panic("checkpoint");
+    off = 0;
+    for (i = 0; i < n; i += m) {
+      m = n - i < NSHADOW ? n - i : NSHADOW;
+      // read the home blocks that are only partly logged
+      // into shadow bufs outside the cache, whose buffers
+      // may hold newer changes.
+      blk_plug();
+      for (j = 0; j < m; j++) {
+        shadow[j].dev = log.dev;
+        shadow[j].blockno = cpblock[i+j];
+        shadow[j].data = shadowdata[j];
+        if (cplen[i+j] < BSIZE)
+          blk_submit(&shadow[j], 0);
+      }
+      blk_unplug();
+      // apply the logged bytes and write them home.
+      blk_plug();
+      for (j = 0; j < m; j++) {
+        if (cplen[i+j] < BSIZE)
+          blk_wait(&shadow[j]);
+        read_bytes(pos, n, off, shadowdata[j] + cpoff[i+j], cplen[i+j]);
+        off += cplen[i+j];
+        blk_submit(&shadow[j], 1);
+      }
+      blk_unplug();
+      for (j = 0; j < m; j++) {
+        blk_wait(&shadow[j]);
+        // the home block on disk is as new as this
+        // transaction; let go of its buffer.
+        struct buf *b = bread(log.dev, cpblock[i+j]);
+        b->logged--;
+        bunpin(b);
+        brelse(b);
+      }
+    }
+    tail = pos + NDESC(n) + NDATA(nbytes) + 1;
+  }
+
+  if (done > 0) {
+    // the space is free once the log says so.
+    write_super(tail, seq + 1);
+    acquire(&log.lock);
+    log.t0 = (log.t0 + done) % NTRANS;
+    log.nt -= done;
+    log.tail = tail;
+    release(&log.lock);
+  }
+  releasesleep(&log.ckptlock);
+}
+
+// Kernel thread that checkpoints committed transactions
+// in the background once they take up half the log.
+static void
+checkpointer(void)
+{
+  for (;;) {
+    acquire(&log.lock);
+    while (log.head - log.tail <= log.area / 2 && log.nt < NTRANS / 2)
+      sleep(&log.nt, &log.lock);
+    release(&log.lock);
+    checkpoint(NTRANS);
+  }
 }
 
 // only when write file call this function, read is not needed
-// called at the start of each FS system call.
+// called at the start of each FS system call that
+// writes at most n distinct blocks to the log and
+// nd file data blocks.
 void
-begin_op(void)
+begin_opn(int n, int nd)
 {
+  struct proc *p = myproc();
+
+  if(n > log.cap || nd > NORDERED)
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.lh.n + log.reserved + n > log.cap ||
+              log.ndata + log.dreserved + nd > NORDERED){
+      // this op might exhaust log space or the ordered
+      // list; wait for commit.
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      log.dreserved += nd;
+      p->logres = n;
+      p->datares = nd;
       release(&log.lock);
       break;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS, 0);
+}
+
 // called at the end of each FS system call.
 // commits if this was the last outstanding operation.
 void
@@ -151,6 +429,8 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= myproc()->logres;
+  log.dreserved -= myproc()->datares;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -175,50 +455,190 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write the transaction's ordered data blocks in place.
 static void
-write_log(void)
+write_data(void)
 {
-  int tail;
+  int i;
+
+  // a block still due to be checkpointed as metadata
+  // must get there before its new contents do.
+  for (i = 0; i < log.ndata; i++) {
+    struct buf *b = bread(log.dev, log.data[i]);
+    int logged = b->logged;
+    brelse(b);
+    if (logged) {
+      checkpoint(NTRANS);
+      break;
+    }
+  }
 
+  blk_plug();
+  for (i = 0; i < log.ndata; i++) {
+    iobuf[i] = bread(log.dev, log.data[i]);
+    bwrite_start(iobuf[i]);
+  }
+  blk_unplug();
+  for (i = 0; i < log.ndata; i++) {
+    bwait(iobuf[i]);
+    bunpin(iobuf[i]);
+    brelse(iobuf[i]);
+  }
+  log.ndata = 0;
+}
+
+// Write the descriptor and the modified bytes of each
+// logged block to the log at pos. Returns the number of
+// blocks the modified bytes took.
+static int
+write_log(uint64 pos)
+{
+  struct buf *to;
+  int d, b, j, k, m, off, len, tail, nb;
+
+  d = NDESC(log.lh.n);
+  k = 0;
+  blk_plug();
+  for (b = 0; b < d; b++) {
+    struct buf *buf = bfresh(log.dev, LOGBLOCK(pos + b)); // descriptor
+    int *a = (int *) (buf->data);
+    memset(buf->data, 0, BSIZE);
+    for (j = 0; j < LHPB; j++) {
+      int idx = b*LHPB + j;
+      int e = (idx - DESCHDR) / DESCENT;
+      if (idx == 0)
+        a[j] = LOGDESC;
+      else if (idx == 1)
+        a[j] = log.seq;
+      else if (idx == 2)
+        a[j] = log.lh.n;
+      else if (e >= log.lh.n)
+        break;
+      else if ((idx - DESCHDR) % DESCENT == 0)
+        a[j] = log.lh.block[e];
+      else if ((idx - DESCHDR) % DESCENT == 1)
+        a[j] = log.lh.lo[e];
+      else
+        a[j] = log.lh.hi[e] - log.lh.lo[e];
+    }
+    buf->valid = 1;
+    bwrite_start(buf);
+    iobuf[k++] = buf;
+  }
+
+  // pack the modified bytes end to end.
+  nb = 0;
+  to = 0;
+  off = 0;
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    len = log.lh.hi[tail] - log.lh.lo[tail];
+    for (j = 0; j < len; j += m) {
+      if (to == 0) {
+        to = bfresh(log.dev, LOGBLOCK(pos + d + nb)); // log block
+        memset(to->data, 0, BSIZE);
+        nb++;
+        off = 0;
+      }
+      m = len - j < BSIZE - off ? len - j : BSIZE - off;
+      memmove(to->data + off, from->data + log.lh.lo[tail] + j, m);
+      off += m;
+      if (off == BSIZE) {
+        to->valid = 1;
+        bwrite_start(to);  // write the log
+        iobuf[k++] = to;
+        to = 0;
+      }
+    }
+    from->logged++;    // keep it pinned until checkpointed
     brelse(from);
-    brelse(to);
   }
+  if (to) {
+    to->valid = 1;
+    bwrite_start(to);
+    iobuf[k++] = to;
+  }
+  blk_unplug();
+  for (j = 0; j < k; j++) {
+    bwait(iobuf[j]);
+    brelse(iobuf[j]);
+  }
+  return nb;
+}
+
+// Write the commit block of the transaction at pos,
+// whose modified bytes took nb blocks.
+static void
+write_commit(uint64 pos, int nb)
+{
+  struct buf *buf = bfresh(log.dev, LOGBLOCK(pos + NDESC(log.lh.n) + nb));
+  int *a = (int *) (buf->data);
+
+  memset(buf->data, 0, BSIZE);
+  a[0] = LOGCOMMIT;
+  a[1] = log.seq;
+  a[2] = log.lh.n;
+  buf->valid = 1;
+  bwrite(buf);
+  brelse(buf);
 }
 
 static void
 commit()
 {
+  uint64 pos;
+  int i, need, nbytes, nb, ok;
+
+  write_data();      // Data before the metadata that points to it
   if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    // checkpoint until the transaction fits.
+    nbytes = 0;
+    for (i = 0; i < log.lh.n; i++)
+      nbytes += log.lh.hi[i] - log.lh.lo[i];
+    need = NDESC(log.lh.n) + NDATA(nbytes) + 1;
+    while (1) {
+      acquire(&log.lock);
+      ok = log.area - (log.head - log.tail) >= need && log.nt < NTRANS;
+      release(&log.lock);
+      if (ok)
+        break;
+      checkpoint(1);
+    }
+    pos = log.head;
+    nb = write_log(pos);    // Write descriptor and modified bytes to log
+    write_commit(pos, nb);  // Write commit block -- the real commit
+    acquire(&log.lock);
+    log.trans[(log.t0 + log.nt) % NTRANS].pos = pos;
+    log.trans[(log.t0 + log.nt) % NTRANS].seq = log.seq;
+    log.nt++;
+    log.head = pos + need;
+    log.seq++;
+    if (log.head - log.tail > log.area / 2 || log.nt >= NTRANS / 2)
+      wakeup(&log.nt);  // checkpointer
+    release(&log.lock);
+    log.lh.n = 0;      // the pins now belong to the checkpoint
   }
 }
 
-// Caller has modified b->data and is done with the buffer.
-// Record the block number and pin in the cache by increasing refcnt.
+// Caller has modified b->data[off..off+n-1] and is done
+// with the buffer. Record the block number and the range,
+// and pin in the cache by increasing refcnt.
 // commit()/write_log() will do the disk write.
 //
-// log_write() replaces bwrite(); a typical use is:
+// log_write_range() replaces bwrite(); a typical use is:
 //   bp = bread(...)
-//   modify bp->data[]
-//   log_write(bp)
+//   modify bp->data[off..off+n-1]
+//   log_write_range(bp, off, n)
 //   brelse(bp)
 void
-log_write(struct buf *b)
+log_write_range(struct buf *b, uint off, uint n)
 {
   int i;
 
+  if (n == 0 || off + n > BSIZE)
+    panic("log_write_range");
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -227,11 +647,82 @@ log_write(struct buf *b)
     if (log.lh.block[i] == b->blockno)   // log absorption
       break;
   }
-  log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
-    bpin(b);
+    log.lh.block[i] = b->blockno;
+    if (undata(b->blockno)) {
+      // keep the ordered list's pin, and log all of
+      // the data written to the block.
+      off = 0;
+      n = BSIZE;
+    } else {
+      bpin(b);
+    }
+    log.lh.lo[i] = off;
+    log.lh.hi[i] = off + n;
     log.lh.n++;
+  } else {
+    if (off < log.lh.lo[i])
+      log.lh.lo[i] = off;
+    if (off + n > log.lh.hi[i])
+      log.lh.hi[i] = off + n;
+  }
+  release(&log.lock);
+}
+
+// Log all of b.
+void
+log_write(struct buf *b)
+{
+  log_write_range(b, 0, BSIZE);
+}
+
+// Remove blockno from the ordered list, e.g. because a freed
+// data block is being reused as metadata and must be logged.
+// Returns 1 if it was there.
+static int
+undata(uint blockno)
+{
+  int i;
+
+  for (i = 0; i < log.ndata; i++) {
+    if (log.data[i] == blockno) {
+      log.data[i] = log.data[--log.ndata];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Like log_write(), but for file data, which commit() writes
+// in place ahead of the log instead of logging.
+void
+log_write_data(struct buf *b)
+{
+  int i;
+
+  acquire(&log.lock);
+  if (log.outstanding < 1)
+    panic("log_write_data outside of trans");
+
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno) {  // already logged
+      log.lh.lo[i] = 0;  // so log the data too
+      log.lh.hi[i] = BSIZE;
+      release(&log.lock);
+      return;
+    }
+  }
+  for (i = 0; i < log.ndata; i++) {
+    if (log.data[i] == b->blockno) {  // ordered list absorption
+      release(&log.lock);
+      return;
+    }
   }
+  // begin_opn() reserved the slot.
+  if (log.ndata >= NORDERED)
+    panic("log_write_data: ordered list full");
+  log.data[log.ndata++] = b->blockno;
+  bpin(b);
   release(&log.lock);
 }
 
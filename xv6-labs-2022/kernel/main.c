@@ -22,11 +22,14 @@ main()
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
+    profinit();      // sampling profiler
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
+    blkinit();       // block I/O request queue
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    renameinit();    // rename lock
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
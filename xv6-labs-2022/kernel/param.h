@@ -11,8 +11,21 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#ifndef LOGSIZE
+#ifdef LAB_FS
+#define LOGSIZE      (MAXOPBLOCKS*30) // blocks in the log mkfs makes
+#else
+#define LOGSIZE      (MAXOPBLOCKS*3)  // blocks in the log mkfs makes
+#endif
+#endif
+#define MAXLOGSIZE   1024 // max blocks in one transaction
+#define MAXRWV       16   // max blocks in one disk request
+#define NORDERED     128 // max unlogged file data blocks per transaction
+#define NBUF         (MAXOPBLOCKS*3)  // minimum size of disk block cache
+#ifndef BCACHEFRAC
+#define BCACHEFRAC   32  // disk block cache gets 1/BCACHEFRAC of RAM at boot
+#endif
+#define BREGROW      100 // ticks after a shrink before the cache regrows
 #ifdef LAB_FS
 #define FSSIZE       200000  // size of file system in blocks
 #else
@@ -23,5 +36,7 @@
 #endif
 #endif
 #define MAXPATH      128   // maximum file path name
+#define MAXSYMLINKS  10    // symlinks a path lookup may follow
+#define NPROFSAMPLE  512   // profiler samples buffered per CPU
 
 
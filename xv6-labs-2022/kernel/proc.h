@@ -103,5 +103,10 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files, max is 16
   struct inode *cwd;           // Current directory
+  int logres;                  // Log blocks reserved by begin_opn()
+  int datares;                 // Ordered list slots reserved by it
+  int plugged;                 // blk_plug() depth
+  struct buf *plugq;           // Disk requests held back by blk_plug()
+  void (*kfn)(void);           // Kernel thread body, for kproc()
   char name[16];               // Process name (debugging)
 };
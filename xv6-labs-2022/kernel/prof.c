@@ -0,0 +1,183 @@
+//
+// Sampling CPU profiler.
+//
+// While profiling is on, every timer interrupt on every CPU
+// records the interrupted pc in that CPU's sample buffer.
+// If the interrupt arrived in the kernel, the sample also
+// holds the return addresses found by walking the frame
+// pointers of the interrupted kernel stack. user/prof.c
+// drains the buffers with profread() and prints the samples
+// for prof.py to symbolize against kernel.sym and _prog.sym.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "prof.h"
+
+extern char etext[];  // kernel.ld sets this to end of kernel code.
+
+// kernelvec.S; kerneltrap() returns somewhere between the two.
+extern char kernelvec[], timervec[];
+
+struct {
+  struct spinlock lock;
+  struct profsample s[NPROFSAMPLE];
+  int n;        // samples in s[]
+  int dropped;  // samples lost because s[] was full
+} profbuf[NCPU];
+
+int profiling;
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&profbuf[i].lock, "prof");
+}
+
+static int
+kernelpc(uint64 pc)
+{
+  return pc >= KERNBASE && pc < (uint64)etext;
+}
+
+// Walk the kernel stack that the current trap interrupted,
+// appending return addresses to s->pc[].
+//
+// Our own frames lead up to kerneltrap(), whose return
+// address lies in kernelvec. kerneltrap()'s frame pointer
+// is kernelvec's sp, where kernelvec saved the interrupted
+// ra (at 0) and s0 (at 56). All of these frames live in
+// the one page of the current kernel stack.
+static void
+kstackwalk(struct profsample *s)
+{
+  uint64 fp, prev, bottom, top, ra, *regs;
+  int i;
+
+  fp = r_fp();
+  bottom = PGROUNDDOWN(fp - 1);
+  top = bottom + PGSIZE;
+  for(i = 0; i < 4; i++){
+    ra = *(uint64*)(fp - 8);
+    if(ra >= (uint64)kernelvec && ra < (uint64)timervec)
+      break;
+    fp = *(uint64*)(fp - 16);
+    if(fp < bottom + 16 || fp > top)
+      return;
+  }
+  if(i == 4)
+    return;
+
+  regs = (uint64*)fp;
+  ra = regs[0];
+  fp = regs[7];
+  while(s->depth < PROFDEPTH && fp >= bottom + 16 && fp <= top && fp % 16 == 0){
+    prev = fp;
+    if(kernelpc(*(uint64*)(fp - 8))){
+      s->pc[s->depth++] = *(uint64*)(fp - 8);
+      fp = *(uint64*)(fp - 16);
+    } else if(kernelpc(ra)){
+      // the interrupted function is a leaf, which saves
+      // only s0 (at fp-8); its caller's pc is still in ra.
+      s->pc[s->depth++] = ra;
+      fp = *(uint64*)(fp - 8);
+    } else {
+      break;
+    }
+    ra = 0;
+    if(fp <= prev)
+      break;
+  }
+}
+
+// Record one sample for the interrupted code.
+// Called by devintr() on every timer interrupt,
+// with interrupts off.
+void
+profintr(void)
+{
+  struct profsample *s;
+  struct proc *p;
+  int id;
+
+  if(!profiling)
+    return;
+
+  id = cpuid();
+  acquire(&profbuf[id].lock);
+  if(profbuf[id].n >= NPROFSAMPLE){
+    profbuf[id].dropped++;
+    release(&profbuf[id].lock);
+    return;
+  }
+  s = &profbuf[id].s[profbuf[id].n++];
+  s->pc[0] = r_sepc();
+  s->depth = 1;
+  s->cpu = id;
+  s->user = (r_sstatus() & SSTATUS_SPP) == 0;
+  p = myproc();
+  if(p){
+    s->pid = p->pid;
+    safestrcpy(s->name, p->name, sizeof(s->name));
+  } else {
+    s->pid = 0;
+    safestrcpy(s->name, "-", sizeof(s->name));
+  }
+  if(!s->user)
+    kstackwalk(s);
+  release(&profbuf[id].lock);
+}
+
+// Turn profiling on, discarding any old samples, or off.
+// Turning it off returns the number of samples dropped.
+int
+profctl(int on)
+{
+  int i, dropped;
+
+  dropped = 0;
+  for(i = 0; i < NCPU; i++){
+    acquire(&profbuf[i].lock);
+    if(on)
+      profbuf[i].n = 0;
+    dropped += profbuf[i].dropped;
+    profbuf[i].dropped = 0;
+    release(&profbuf[i].lock);
+  }
+  __sync_synchronize();
+  profiling = on;
+  return on ? 0 : dropped;
+}
+
+// Move up to n samples to the user array at addr.
+// Returns the number of samples copied, or -1.
+int
+profread(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct profsample s;
+  int i, got;
+
+  got = 0;
+  for(i = 0; i < NCPU && got < n; i++){
+    while(got < n){
+      acquire(&profbuf[i].lock);
+      if(profbuf[i].n == 0){
+        release(&profbuf[i].lock);
+        break;
+      }
+      s = profbuf[i].s[--profbuf[i].n];
+      release(&profbuf[i].lock);
+      if(copyout(p->pagetable, addr + got*sizeof(s), (char*)&s, sizeof(s)) < 0)
+        return -1;
+      got++;
+    }
+  }
+  return got;
+}
@@ -0,0 +1,12 @@
+// Sampling profiler records, shared by the kernel and user/prof.c.
+
+#define PROFDEPTH 8   // max pcs recorded per sample
+
+struct profsample {
+  uint64 pc[PROFDEPTH]; // pc[0] is the interrupted pc, then return addresses
+  int depth;            // number of valid entries in pc[]
+  int pid;              // interrupted process, or 0 if none
+  char name[16];        // its p->name, to find the user symbol table
+  char cpu;             // cpu that took the sample
+  char user;            // 1 if interrupted in user mode, 0 if in the kernel
+};
@@ -319,6 +319,15 @@ r_ra()
   return x;
 }
 
+// read the frame pointer, s0, of the calling function.
+static inline uint64
+r_fp()
+{
+  uint64 x;
+  asm volatile("mv %0, s0" : "=r" (x) );
+  return x;
+}
+
 // flush the TLB.
 static inline void
 sfence_vma()
@@ -102,6 +102,22 @@ extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 extern uint64 sys_symlink(void);
+extern uint64 sys_profile(void);
+extern uint64 sys_profread(void);
+extern uint64 sys_bcachestat(void);
+extern uint64 sys_bcachepolicy(void);
+extern uint64 sys_diskstat(void);
+extern uint64 sys_diskpoll(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_stat(void);
+extern uint64 sys_openat(void);
+extern uint64 sys_fstatat(void);
+extern uint64 sys_rename(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -128,6 +144,22 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_symlink] sys_symlink,
+[SYS_profile] sys_profile,
+[SYS_profread] sys_profread,
+[SYS_bcachestat] sys_bcachestat,
+[SYS_bcachepolicy] sys_bcachepolicy,
+[SYS_diskstat] sys_diskstat,
+[SYS_diskpoll] sys_diskpoll,
+[SYS_lseek]   sys_lseek,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_getdents] sys_getdents,
+[SYS_stat]    sys_stat,
+[SYS_openat]  sys_openat,
+[SYS_fstatat] sys_fstatat,
+[SYS_rename]  sys_rename,
 };
 
 void
@@ -20,4 +20,20 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
-#define SYS_symlink  22
\ No newline at end of file
+#define SYS_symlink  22
+#define SYS_profile  23
+#define SYS_profread 24
+#define SYS_bcachestat 25
+#define SYS_bcachepolicy 26
+#define SYS_diskstat 27
+#define SYS_diskpoll 28
+#define SYS_lseek  29
+#define SYS_pread  30
+#define SYS_pwrite 31
+#define SYS_readv  32
+#define SYS_writev 33
+#define SYS_getdents 34
+#define SYS_stat   35
+#define SYS_openat 36
+#define SYS_fstatat 37
+#define SYS_rename 38
\ No newline at end of file
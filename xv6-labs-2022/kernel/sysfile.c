@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "iostat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -34,6 +36,26 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
+// Fetch the nth argument as the directory file descriptor of
+// an *at() call and return its inode in *dpp, or 0 for
+// AT_FDCWD, meaning the current directory.
+static int
+argdirfd(int n, struct inode **dpp)
+{
+  struct file *f;
+  int fd;
+
+  argint(n, &fd);
+  if(fd == AT_FDCWD){
+    *dpp = 0;
+    return 0;
+  }
+  if(argfd(n, 0, &f) < 0 || f->type != FD_INODE)
+    return -1;
+  *dpp = f->ip;
+  return 0;
+}
+
 // fdalloc根据给定的ftable中的打开文件f，在用户进程的打开文件表ofile中记录f，并且分配一个文件描述符。
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
@@ -120,6 +142,56 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Copy the stat of path, relative to directory dp or the
+// current directory, to user address addr, without opening it.
+static int
+statat(struct inode *dp, char *path, int follow, uint64 addr)
+{
+  struct inode *ip;
+  struct stat st;
+
+  begin_op();  // for the iput()s in the path walk
+  if((ip = nameiat(dp, path, follow)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  stati(ip, &st);
+  iunlockput(ip);
+  end_op();
+  return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+}
+
+uint64
+sys_stat(void)
+{
+  char path[MAXPATH];
+  uint64 st;
+
+  argaddr(1, &st);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return statat(0, path, 1, st);
+}
+
+// fstatat(dirfd, path, st, flags): like stat(), but a relative
+// path starts from directory dirfd, and with AT_SYMLINK_NOFOLLOW
+// a final symbolic link is not followed.
+uint64
+sys_fstatat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp;
+  uint64 st;
+  int flags;
+
+  argaddr(2, &st);
+  argint(3, &flags);
+  if(argdirfd(0, &dp) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+  return statat(dp, path, !(flags & AT_SYMLINK_NOFOLLOW), st);
+}
+
 // sys_link为给定的inode创建新的目录条目，即创建新的硬链接。
 // 首先sys_link从寄存器获取参数，a0是旧路径名，a1是新路径名。
 // 如果旧路径名存在而且不是目录（目录不能创建硬链接），那么就使该inode的硬链接数加1。
@@ -253,18 +325,187 @@ bad:
   return -1;
 }
 
+// held across a rename, so that the shape of the directory
+// tree can't change while it checks for loops and picks the
+// order to lock the two parents in.
+static struct sleeplock renamelock;
+
+void
+renameinit(void)
+{
+  initsleeplock(&renamelock, "rename");
+}
+
+// Is directory a the same as d or one of its ancestors?
+// Caller holds renamelock and no inode locks.
+static int
+isancestor(struct inode *a, struct inode *d)
+{
+  struct inode *ip, *next;
+  int r;
+
+  ip = idup(d);
+  while(ip != a && ip->inum != ROOTINO){
+    ilock(ip);
+    next = dirlookup(ip, "..", 0);
+    iunlockput(ip);
+    if(next == 0)
+      return 0;
+    ip = next;
+  }
+  r = ip == a;
+  iput(ip);
+  return r;
+}
+
+// rename(old, new): move old's directory entry to new in one
+// transaction, replacing new if it exists. A directory can
+// only replace an empty directory, and can't be moved below
+// itself; a non-directory can't replace a directory.
+uint64
+sys_rename(void)
+{
+  char old[MAXPATH], new[MAXPATH], oname[DIRSIZ], nname[DIRSIZ];
+  struct inode *odp, *ndp, *ip, *tp, *x, *y;
+  struct dirent de;
+  uint ooff, noff, off;
+  int dir, ok, r;
+
+  if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
+    return -1;
+
+  // lock before begin_op(), so that a rename waiting for the
+  // lock doesn't hold up the commit its holder may wait for.
+  acquiresleep(&renamelock);
+  begin_op();
+  r = -1;
+  odp = ndp = ip = tp = 0;
+  if((odp = nameiparent(old, oname)) == 0 || (ndp = nameiparent(new, nname)) == 0)
+    goto out;
+  if(namecmp(oname, ".") == 0 || namecmp(oname, "..") == 0 ||
+     namecmp(nname, ".") == 0 || namecmp(nname, "..") == 0)
+    goto out;
+
+  ilock(odp);
+  ip = dirlookup(odp, oname, 0);
+  iunlock(odp);
+  ilock(ndp);
+  tp = dirlookup(ndp, nname, 0);
+  iunlock(ndp);
+  if(ip == 0)
+    goto out;
+  ilock(ip);
+  dir = ip->type == T_DIR;
+  iunlock(ip);
+  // no moving a directory below itself, or replacing one
+  // of old's ancestors (which can't be empty).
+  if(dir && isancestor(ip, ndp))
+    goto out;
+  if(tp && isancestor(tp, odp))
+    goto out;
+
+  // lock a parent before its child, as sys_unlink() does.
+  if(odp == ndp)
+    ilock(odp);
+  else if(isancestor(odp, ndp)){
+    ilock(odp);
+    ilock(ndp);
+  } else {
+    ilock(ndp);
+    ilock(odp);
+  }
+
+  // an unlink or create may have come in between.
+  x = dirlookup(odp, oname, &ooff);
+  y = dirlookup(ndp, nname, &noff);
+  ok = x == ip && y == tp;
+  if(x)
+    iput(x);
+  if(y)
+    iput(y);
+  if(!ok)
+    goto unlock;
+  if(ip == tp){
+    r = 0;  // old and new are links to the same inode
+    goto unlock;
+  }
+
+  // the new entry first, so that running out of blocks to
+  // extend ndp with leaves nothing changed.
+  if(tp){
+    ilock(tp);
+    if(dir != (tp->type == T_DIR) || (dir && !isdirempty(tp))){
+      iunlock(tp);
+      goto unlock;
+    }
+    memset(&de, 0, sizeof(de));
+    strncpy(de.name, nname, DIRSIZ);
+    de.inum = ip->inum;
+    if(writei(ndp, 0, (uint64)&de, noff, sizeof(de)) != sizeof(de))
+      panic("rename: writei");
+    if(dir){
+      ndp->nlink--;  // for tp's ".."
+      iupdate(ndp);
+    }
+    tp->nlink--;
+    iupdate(tp);
+    iunlock(tp);
+  } else if(dirlink(ndp, nname, ip->inum) < 0)
+    goto unlock;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(odp, 0, (uint64)&de, ooff, sizeof(de)) != sizeof(de))
+    panic("rename: writei");
+
+  if(dir && odp != ndp){
+    // point ".." at the new parent.
+    ilock(ip);
+    if((x = dirlookup(ip, "..", &off)) == 0)
+      panic("rename: no ..");
+    iput(x);
+    strncpy(de.name, "..", DIRSIZ);
+    de.inum = ndp->inum;
+    if(writei(ip, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("rename: writei");
+    iunlock(ip);
+    odp->nlink--;
+    iupdate(odp);
+    ndp->nlink++;
+    iupdate(ndp);
+  }
+  r = 0;
+
+ unlock:
+  iunlock(odp);
+  if(ndp != odp)
+    iunlock(ndp);
+ out:
+  // a replaced tp is freed here if that was its last link.
+  if(tp)
+    iput(tp);
+  if(ip)
+    iput(ip);
+  if(ndp)
+    iput(ndp);
+  if(odp)
+    iput(odp);
+  end_op();
+  releasesleep(&renamelock);
+  return r;
+}
+
 
 // 以下三种情况会用到create
 // open with the O_CREATE flag makes a new ordinary file
 // mkdir makes a new directory  
 // mkdev makes a new device file
 static struct inode*
-create(char *path, short type, short major, short minor)
+create(struct inode *at, char *path, short type, short major, short minor)
 {
   struct inode *ip, *dp;
   char name[DIRSIZ];
 
-  if((dp = nameiparent(path, name)) == 0)
+  if((dp = nameiparentat(at, path, name)) == 0)
     return 0;
 
   ilock(dp);
@@ -280,7 +521,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0){
+  if((ip = ialloc(dp->dev, type, dp->inum)) == 0){
     iunlockput(dp);
     return 0;
   }
@@ -319,29 +560,26 @@ create(char *path, short type, short major, short minor)
   return 0;
 }
 
-uint64
-sys_open(void)
+// Open path, relative to directory dp or, if dp is 0, to the
+// current directory, and return a new file descriptor.
+static int
+openat(struct inode *dp, char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  argint(1, &omode);
-  if((n = argstr(0, path, MAXPATH)) < 0)
-    return -1;
 
   begin_op();
 
   if(omode & O_CREATE){
-    ip = create(path, T_FILE, 0, 0); // create 内部存在ilock没哟释放
+    ip = create(dp, path, T_FILE, 0, 0); // create 内部存在ilock没哟释放
     if(ip == 0){
       end_op();
       return -1;
     }
   } else {
-    if((ip = namei(path)) == 0){
+    // namei() follows symlinks; O_NOFOLLOW opens the link itself.
+    if((ip = nameiat(dp, path, !(omode & O_NOFOLLOW))) == 0){
       end_op();
       return -1;
     }
@@ -372,38 +610,6 @@ sys_open(void)
   if(ip->type == T_DEVICE){
     f->type = FD_DEVICE;
     f->major = ip->major;
-  } else if(ip->type == T_SYMLINK){
-    // open a symbolic link
-    f->type = FD_INODE;
-    f->off = 0;
-    if(omode & O_NOFOLLOW){ // open the symbolic link self
-
-    } else{ // open the link file, get link filename from data block
-      
-      end_op(); // 先结束上面的事务，因为要读的文件边变成了 linked file, path 换成其他的文件了
-      
-      int max_recursion_depth = 10;
-      while(max_recursion_depth){
-        
-        readi(ip, 1, (uint64)(&path), 0, ip->size);// data 区域存的的link filename
-        max_recursion_depth--;
-
-        begin_op();
-        if((ip = namei(path)) == 0){
-          end_op();
-          return -1;// make sure the linked file exist
-        }
-        if(ip->type != T_SYMLINK){
-          end_op();
-          break;
-        }
-      }
-
-      if(max_recursion_depth < 0){
-        end_op();
-        return -1;// the links form a cycle 
-      }
-    }
   } else{
     f->type = FD_INODE;
     f->off = 0;
@@ -423,6 +629,33 @@ sys_open(void)
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  argint(1, &omode);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return openat(0, path, omode);
+}
+
+// openat(dirfd, path, omode): like open(), but a relative
+// path starts from directory dirfd.
+uint64
+sys_openat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp;
+  int omode;
+
+  argint(2, &omode);
+  if(argdirfd(0, &dp) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+  return openat(dp, path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -430,7 +663,7 @@ sys_mkdir(void)
   struct inode *ip;
 
   begin_op();
-  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if(argstr(0, path, MAXPATH) < 0 || (ip = create(0, path, T_DIR, 0, 0)) == 0){
     end_op();
     return -1;
   }
@@ -450,7 +683,7 @@ sys_mknod(void)
   argint(1, &major);
   argint(2, &minor);
   if((argstr(0, path, MAXPATH)) < 0 ||
-     (ip = create(path, T_DEVICE, major, minor)) == 0){
+     (ip = create(0, path, T_DEVICE, major, minor)) == 0){
     end_op();
     return -1;
   }
@@ -568,10 +801,10 @@ sys_symlink(void)
   int n;
   struct inode* ip;
 
-  if(argstr(0, linkpath, MAXPATH) < 0)
-    return -1;
   if((n = argstr(0, target, MAXPATH)) < 0)
     return -1;
+  if(argstr(1, linkpath, MAXPATH) < 0)
+    return -1;
 
   
 
@@ -590,7 +823,7 @@ sys_symlink(void)
   // 3 inode号可以方便地实现文件系统的抽象层次。例如，xv6中有一种特殊的inode类型叫做设备inode，它对应了一些设备文件（如控制台、磁盘等）。
   //   使用inode号可以让系统以统一的方式处理不同类型的文件。
   begin_op();
-  ip = create(linkpath, T_SYMLINK, 0, 0);
+  ip = create(0, linkpath, T_SYMLINK, 0, 0);
   if(ip == 0){
     end_op();
     return -1;
@@ -608,3 +841,187 @@ sys_symlink(void)
   end_op();
   return 0;
 }
+
+// copy the buffer cache counters to a user struct bcachestat.
+uint64
+sys_bcachestat(void)
+{
+  uint64 addr;
+  struct bcachestat st;
+
+  argaddr(0, &addr);
+  bstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// select the buffer cache replacement policy; returns the old one.
+uint64
+sys_bcachepolicy(void)
+{
+  int policy;
+
+  argint(0, &policy);
+  return bsetpolicy(policy);
+}
+
+// copy the disk driver's counters to a user struct diskstat.
+uint64
+sys_diskstat(void)
+{
+  uint64 addr;
+  struct diskstat st;
+
+  argaddr(0, &addr);
+  virtio_disk_stat(&st);
+  blkstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// set how many microseconds the disk driver polls for each
+// completion before sleeping; returns the old setting.
+uint64
+sys_diskpoll(void)
+{
+  int us;
+
+  argint(0, &us);
+  return virtio_disk_poll(us);
+}
+
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  uint64 off;
+  int whence;
+
+  argaddr(1, &off);  // 64 bits, and may be negative
+  argint(2, &whence);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return fileseek(f, (long)off, whence);
+}
+
+// read from fd at offset off, leaving its offset alone.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  uint64 p, off;
+  int n;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argaddr(3, &off);
+  if(argfd(0, 0, &f) < 0 || n < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1, &off);
+}
+
+// write to fd at offset off, leaving its offset alone.
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  uint64 p, off;
+  int n;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argaddr(3, &off);
+  if(argfd(0, 0, &f) < 0 || n < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1, &off);
+}
+
+// copy in the user's array of n iovecs at addr.
+static int
+argiov(uint64 addr, int n, struct iovec *iov)
+{
+  uint64 tot;
+  int i;
+
+  if(n < 0 || n > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, addr, n*sizeof(struct iovec)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < n; i++){
+    tot += iov[i].iov_len;
+    if(iov[i].iov_len > 0x7fffffff || tot > 0x7fffffff)
+      return -1;  // the total must fit the return value
+  }
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 p;
+  int n;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  if(argfd(0, 0, &f) < 0 || argiov(p, n, iov) < 0)
+    return -1;
+  return filereadv(f, iov, n, 0);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 p;
+  int n;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  if(argfd(0, 0, &f) < 0 || argiov(p, n, iov) < 0)
+    return -1;
+  return filewritev(f, iov, n, 0);
+}
+
+// read up to n entries of directory fd into buf, along with
+// each one's type, link count and size if plus is set.
+// returns the number of entries read, 0 at the end.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  struct direntplus d[16];
+  uint64 p, off;
+  int n, plus, tot, k;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &plus);
+  if(argfd(0, 0, &f) < 0 || f->type != FD_INODE || !f->readable || n < 0)
+    return -1;
+  for(tot = 0; tot < n; tot += k){
+    k = n - tot < NELEM(d) ? n - tot : NELEM(d);
+    off = f->off;
+    if((k = dirread(f->ip, &f->off, d, k, plus)) < 0)
+      return -1;
+    if(k == 0)
+      break;
+    if(copyout(myproc()->pagetable, p + tot*sizeof(d[0]), (char*)d, k*sizeof(d[0])) < 0){
+      // leave the entries that weren't copied for next time.
+      f->off = off;
+      return tot > 0 ? tot : -1;
+    }
+  }
+  return tot;
+}
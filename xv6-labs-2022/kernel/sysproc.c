@@ -91,3 +91,27 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// start (1) or stop (0) the sampling profiler.
+uint64
+sys_profile(void)
+{
+  int on;
+
+  argint(0, &on);
+  return profctl(on != 0);
+}
+
+// copy up to n profiler samples to a user array.
+uint64
+sys_profread(void)
+{
+  uint64 p;
+  int n;
+
+  argaddr(0, &p);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+  return profread(p, n);
+}
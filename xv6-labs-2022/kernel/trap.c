@@ -208,7 +208,8 @@ devintr()
     if(cpuid() == 0){
       clockintr();
     }
-    
+    profintr();
+
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
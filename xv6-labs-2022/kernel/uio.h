@@ -0,0 +1,9 @@
+// Scatter/gather I/O, shared by the kernel and user programs.
+
+// one buffer of a readv() or writev().
+struct iovec {
+  void *iov_base;
+  uint64 iov_len;
+};
+
+#define IOV_MAX 16  // most buffers in one readv() or writev()
@@ -45,9 +45,11 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
-// this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// at most this many virtio descriptors; the queue is
+// this big or as big as the device allows, if smaller.
+// must be a power of two. the descriptor table must
+// fit in one page.
+#define NUM 256
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -58,13 +60,14 @@ struct virtq_desc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr is a table of descriptors
 
 // the (entire) avail ring, from the spec.
+// with a queue of num entries, ring[num] is used_event.
 struct virtq_avail {
   uint16 flags; // always zero
   uint16 idx;   // driver will write ring[idx] next
-  uint16 ring[NUM]; // descriptor numbers of chain heads
-  uint16 unused;
+  uint16 ring[NUM+1]; // descriptor numbers of chain heads
 };
 
 // one entry in the "used" ring, with which the
@@ -74,12 +77,27 @@ struct virtq_used_elem {
   uint32 len;
 };
 
+// with a queue of num entries, the uint16 after
+// ring[num-1] is avail_event, which event[] overlays.
 struct virtq_used {
   uint16 flags; // always zero
   uint16 idx;   // device increments when it adds a ring[] entry
-  struct virtq_used_elem ring[NUM];
+  union {
+    struct virtq_used_elem ring[NUM];
+    volatile uint16 event[4*NUM+1]; // event[4*num] is avail_event
+  };
 };
 
+// with VIRTIO_RING_F_EVENT_IDX, the device interrupts only
+// when used->idx passes used_event, and the driver need only
+// notify when avail->idx passes avail_event.
+#define VRING_USED_EVENT(avail, num) ((avail)->ring[(num)])
+#define VRING_AVAIL_EVENT(used, num) ((used)->event[4*(num)])
+
+// does moving an index from old to new pass event?
+#define VRING_NEED_EVENT(event, new, old) \
+  ((uint16)((new) - (event) - 1) < (uint16)((new) - (old)))
+
 // these are specific to virtio block devices, e.g. disks,
 // described in Section 5.2 of the spec.
 
@@ -87,8 +105,8 @@ struct virtq_used {
 #define VIRTIO_BLK_T_OUT 1 // write the disk
 
 // the format of the first descriptor in a disk request.
-// to be followed by two more descriptors containing
-// the block, and a one-byte status.
+// to be followed by descriptors containing the
+// blocks, and a one-byte status.
 struct virtio_blk_req {
   uint32 type; // VIRTIO_BLK_T_IN or ..._OUT
   uint32 reserved;
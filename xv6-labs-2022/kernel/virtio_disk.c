@@ -15,6 +15,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "iostat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -22,31 +23,41 @@
 static struct disk {
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
-  // disk operations. there are NUM descriptors.
-  // most commands consist of a "chain" (a linked list) of a couple of
-  // these descriptors.
+  // disk operations. there are num descriptors.
+  // each command is a single descriptor that points to
+  // that descriptor's chain in ind[].
   struct virtq_desc *desc;
 
   // a ring in which the driver writes descriptor numbers
   // that the driver would like the device to process.  it only
   // includes the head descriptor of each chain. the ring has
-  // NUM elements.
+  // num elements.
   struct virtq_avail *avail;
 
   // a ring in which the device writes descriptor numbers that
   // the device has finished processing (just the head of each chain).
-  // there are NUM used ring entries.
+  // there are num used ring entries.
   struct virtq_used *used;
 
+  // indirect descriptor tables, one per descriptor:
+  // header, up to MAXRWV blocks, status.
+  struct virtq_desc ind[NUM][MAXRWV+2];
+
   // our own book-keeping.
+  int num;         // queue size
+  int eventidx;    // negotiated VIRTIO_RING_F_EVENT_IDX?
+  uint64 poll;     // time units to spin for completion, or 0
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used[2..NUM].
+  uint16 used_idx; // we've looked this far in used[2..num].
+  struct diskstat st;
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b[MAXRWV];
+    int n;
+    uint64 start;  // r_time() at submission
     char status;
   } info[NUM];
 
@@ -90,8 +101,9 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+  if(!(features & (1 << VIRTIO_RING_F_INDIRECT_DESC)))
+    panic("virtio disk has no indirect descriptors");
+  disk.eventidx = (features >> VIRTIO_RING_F_EVENT_IDX) & 1;
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
   // tell device that feature negotiation is complete.
@@ -110,12 +122,13 @@ virtio_disk_init(void)
   if(*R(VIRTIO_MMIO_QUEUE_READY))
     panic("virtio disk should not be ready");
 
-  // check maximum queue size.
+  // use as big a queue as the device and NUM allow.
   uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
-  if(max < NUM)
-    panic("virtio disk max queue too short");
+  disk.num = NUM;
+  while(disk.num > max)
+    disk.num /= 2;
 
   // allocate and zero queue memory.
   disk.desc = kalloc();
@@ -128,7 +141,7 @@ virtio_disk_init(void)
   memset(disk.used, 0, PGSIZE);
 
   // set queue size.
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  *R(VIRTIO_MMIO_QUEUE_NUM) = disk.num;
 
   // write physical addresses.
   *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
@@ -141,8 +154,8 @@ virtio_disk_init(void)
   // queue is ready.
   *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
 
-  // all NUM descriptors start out unused.
-  for(int i = 0; i < NUM; i++)
+  // all num descriptors start out unused.
+  for(int i = 0; i < disk.num; i++)
     disk.free[i] = 1;
 
   // tell device we're completely ready.
@@ -156,7 +169,7 @@ virtio_disk_init(void)
 static int
 alloc_desc()
 {
-  for(int i = 0; i < NUM; i++){
+  for(int i = 0; i < disk.num; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
       return i;
@@ -169,7 +182,7 @@ alloc_desc()
 static void
 free_desc(int i)
 {
-  if(i >= NUM)
+  if(i >= disk.num)
     panic("free_desc 1");
   if(disk.free[i])
     panic("free_desc 2");
@@ -178,64 +191,110 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
-// free a chain of descriptors.
+// count a finished request's latency in the
+// histogram for the way its completion was seen.
 static void
-free_chain(int i)
+latency(uint64 start, int polled)
 {
-  while(1){
-    int flag = disk.desc[i].flags;
-    int nxt = disk.desc[i].next;
-    free_desc(i);
-    if(flag & VRING_DESC_F_NEXT)
-      i = nxt;
-    else
-      break;
-  }
+  uint64 us = (r_time() - start) / (CLINT_HZ / 1000000);
+  int i;
+
+  for(i = 0; i < NDISKLAT-1 && us >= 2; i++)
+    us >>= 1;
+  disk.st.lat[polled][i]++;
+  if(polled)
+    disk.st.polled++;
+  else
+    disk.st.slept++;
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// process completed requests in the used ring,
+// waking the bufs' waiters and freeing descriptors.
+// returns the number of requests completed.
+// caller holds vdisk_lock.
 static int
-alloc3_desc(int *idx)
+reap(int polled)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
+  int n = 0;
+
+  // the device increments disk.used->idx when it
+  // adds an entry to the used ring.
+
+  while(1){
+    while(disk.used_idx != disk.used->idx){
+      __sync_synchronize();
+      int id = disk.used->ring[disk.used_idx % disk.num].id;
+
+      // qemu的virtio disk设备作为磁盘驱动23。disk.info[id].status是一个表示磁盘操作状态的字段23，
+      // 它的值可以是0（空闲），1（正在使用），或者2（完成）2。
+      // 如果disk.info[id].status != 0，那么表示该磁盘操作还没有完成或者已经完成但还没有被处理。
+      if(disk.info[id].status != 0)
+        panic("virtio_disk_intr status");
+
+      for(int i = 0; i < disk.info[id].n; i++){
+        struct buf *b = disk.info[id].b[i];
+        b->disk = 0;   // disk is done with buf
+        wakeup(b);
+        disk.info[id].b[i] = 0;
+      }
+      latency(disk.info[id].start, polled);
+      free_desc(id);
+      n++;
+
+      disk.used_idx += 1;
     }
+    if(!disk.eventidx)
+      break;
+
+    // with event-index, ask for an interrupt only at the
+    // next completion we haven't seen, so completions the
+    // device adds before we get here don't interrupt again.
+    // then look once more, in case one slipped in.
+    VRING_USED_EVENT(disk.avail, disk.num) = disk.used_idx;
+    __sync_synchronize();
+    if(disk.used_idx == disk.used->idx)
+      break;
   }
-  return 0;
+  return n;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// start reading or writing the n bufs in b[], which must
+// hold consecutive blocks, with a single request.
+// returns -1 if the queue is full, without waiting.
+// the bufs' disk flags are already set; virtio_disk_wait()
+// waits for them to clear.
+int
+virtio_disk_start(struct buf **b, int n, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint64 sector = b[0]->blockno * (BSIZE / 512);
+
+  if(n < 1 || n > MAXRWV)
+    panic("virtio_disk_start");
+  for(int i = 1; i < n; i++)
+    if(b[i]->dev != b[0]->dev || b[i]->blockno != b[0]->blockno + i)
+      panic("virtio_disk_start: not consecutive");
 
   acquire(&disk.vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+  // data, one for a 1-byte status result. the data may be split
+  // across several descriptors, one per buf here. they go in an
+  // indirect table, so the request takes one ring descriptor.
+
+  int id = alloc_desc();
+  if(id < 0){
+    release(&disk.vdisk_lock);
+    return -1;
   }
 
-  // format the three descriptors.
+  // format the indirect descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  struct virtio_blk_req *buf0 = &disk.ops[id];
+  struct virtq_desc *d = disk.ind[id];
 
   if(write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
@@ -244,56 +303,104 @@ virtio_disk_rw(struct buf *b, int write)
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  d[0].addr = (uint64) buf0;
+  d[0].len = sizeof(struct virtio_blk_req);
+  d[0].flags = VRING_DESC_F_NEXT;
+  d[0].next = 1;
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 1; i <= n; i++){
+    d[i].addr = (uint64) b[i-1]->data;
+    d[i].len = BSIZE;
+    if(write)
+      d[i].flags = 0; // device reads b->data
+    else
+      d[i].flags = VRING_DESC_F_WRITE; // device writes b->data
+    d[i].flags |= VRING_DESC_F_NEXT;
+    d[i].next = i+1;
+  }
+
+  disk.info[id].status = 0xff; // device writes 0 on success
+  d[n+1].addr = (uint64) &disk.info[id].status;
+  d[n+1].len = 1;
+  d[n+1].flags = VRING_DESC_F_WRITE; // device writes the status
+  d[n+1].next = 0;
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[id].addr = (uint64) d;
+  disk.desc[id].len = (n+2) * sizeof(struct virtq_desc);
+  disk.desc[id].flags = VRING_DESC_F_INDIRECT;
+  disk.desc[id].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the bufs for reap().
+  for(int i = 0; i < n; i++)
+    disk.info[id].b[i] = b[i];
+  disk.info[id].n = n;
+  disk.info[id].start = r_time();
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  uint16 old = disk.avail->idx;
+  disk.avail->ring[old % disk.num] = id;
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  disk.avail->idx = old + 1; // not % num ...
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  // with event-index, the device says how far it has read
+  // the avail ring; if it is still short of this entry it
+  // will get to it without a notification.
+  if(!disk.eventidx ||
+     VRING_NEED_EVENT(VRING_AVAIL_EVENT(disk.used, disk.num), old + 1, old)){
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    disk.st.kicks++;
+  }
+  disk.st.reqs++;
+  disk.st.blocks += n;
+
+  release(&disk.vdisk_lock);
+  return 0;
+}
+
+// wait for the disk to finish with b.
+void
+virtio_disk_wait(struct buf *b)
+{
+  int n = 0;
+
+  acquire(&disk.vdisk_lock);
+
+  // in poll mode, spin watching the used ring for a while,
+  // reaping completions here rather than waiting for the
+  // interrupt, the wakeup() and a trip through the scheduler.
+  if(disk.poll){
+    uint64 end = r_time() + disk.poll;
+    while(b->disk == 1 && r_time() < end){
+      release(&disk.vdisk_lock);
+      while(disk.used_idx == *(volatile uint16 *)&disk.used->idx && r_time() < end)
+        ;
+      acquire(&disk.vdisk_lock);
+      n += reap(1);
+    }
+  }
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
+
+  // completions made room for queued requests.
+  if(n > 0)
+    blk_dispatch();
 }
 
 void
 virtio_disk_intr()
 {
+  int n;
+
   acquire(&disk.vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
@@ -306,25 +413,41 @@ virtio_disk_intr()
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  disk.st.intrs++;
+  n = reap(0);
 
-  while(disk.used_idx != disk.used->idx){
-    __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+  release(&disk.vdisk_lock);
 
-    // qemu的virtio disk设备作为磁盘驱动23。disk.info[id].status是一个表示磁盘操作状态的字段23，
-    // 它的值可以是0（空闲），1（正在使用），或者2（完成）2。
-    // 如果disk.info[id].status != 0，那么表示该磁盘操作还没有完成或者已经完成但还没有被处理。
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
+  if(n > 0)
+    blk_dispatch();
+}
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+// set the time to poll for each completion before sleeping,
+// in microseconds; 0 means always wait for the interrupt.
+// clears the counters, so that they describe the new mode.
+// returns the old time.
+int
+virtio_disk_poll(int us)
+{
+  int old;
 
-    disk.used_idx += 1;
-  }
+  if(us < 0)
+    return -1;
+  acquire(&disk.vdisk_lock);
+  old = disk.poll / (CLINT_HZ / 1000000);
+  disk.poll = (uint64)us * (CLINT_HZ / 1000000);
+  memset(&disk.st, 0, sizeof(disk.st));
+  release(&disk.vdisk_lock);
+  return old;
+}
 
+void
+virtio_disk_stat(struct diskstat *st)
+{
+  acquire(&disk.vdisk_lock);
+  *st = disk.st;
+  st->poll = disk.poll / (CLINT_HZ / 1000000);
+  st->qsize = disk.num;
+  st->eventidx = disk.eventidx;
   release(&disk.vdisk_lock);
 }
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+#
+# Symbolize the samples printed by user/prof.c.
+#
+#   make qemu | tee xv6.out      (then run "prof command" in xv6)
+#   ./prof.py [xv6.out] [prof.folded]
+#
+# Kernel pcs are looked up in kernel/kernel.sym, user pcs in
+# user/<name>.sym. Prints a flat profile of the sampled functions
+# and writes collapsed stacks, one "root;...;leaf count" line per
+# distinct stack, for flamegraph.pl.
+#
+
+import bisect
+import collections
+import os
+import sys
+
+class Symtab:
+    def __init__(self, path):
+        syms = []
+        if os.path.exists(path):
+            with open(path) as f:
+                for line in f:
+                    parts = line.split()
+                    if len(parts) != 2:
+                        continue
+                    addr, name = parts
+                    # skip section and source file names.
+                    if name.startswith('.') or name.endswith(('.c', '.S')):
+                        continue
+                    syms.append((int(addr, 16), name))
+        syms.sort()
+        self.addrs = [a for a, _ in syms]
+        self.names = [n for _, n in syms]
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        if i < 0:
+            return '0x%x' % pc
+        return self.names[i]
+
+def main():
+    log = sys.argv[1] if len(sys.argv) > 1 else 'xv6.out'
+    folded = sys.argv[2] if len(sys.argv) > 2 else 'prof.folded'
+
+    ksyms = Symtab('kernel/kernel.sym')
+    usyms = {}
+    flat = collections.Counter()
+    stacks = collections.Counter()
+    nsamples = 0
+
+    with open(log, errors='replace') as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) < 6 or fields[0] != 'prof:':
+                continue
+            _, cpu, pid, name, mode = fields[:5]
+            pcs = [int(x, 16) for x in fields[5:]]
+            if mode == 'u':
+                if name not in usyms:
+                    usyms[name] = Symtab('user/%s.sym' % name)
+                frames = [name + ':' + usyms[name].lookup(pc) for pc in pcs]
+                root = name
+            else:
+                frames = [ksyms.lookup(pc) for pc in pcs]
+                root = 'kernel'
+            nsamples += 1
+            flat[frames[0]] += 1
+            stacks[';'.join([root] + frames[::-1])] += 1
+
+    if nsamples == 0:
+        print('no samples in %s' % log)
+        return
+
+    print('%8s %6s  %s' % ('samples', '%', 'function'))
+    for fn, n in flat.most_common():
+        print('%8d %6.2f  %s' % (n, 100.0 * n / nsamples, fn))
+
+    with open(folded, 'w') as f:
+        for stack, n in sorted(stacks.items()):
+            f.write('%s %d\n' % (stack, n))
+    print('%d samples; collapsed stacks in %s' % (nsamples, folded))
+
+if __name__ == '__main__':
+    main()
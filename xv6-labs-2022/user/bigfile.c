@@ -3,12 +3,49 @@
 #include "user/user.h"
 #include "kernel/fcntl.h"
 #include "kernel/fs.h"
+#include "kernel/param.h"
+
+// blocks through the doubly-indirect ones, or half the disk
+// if that is fewer (as with 4096-byte blocks); the
+// triply-indirect blocks are only written at a few
+// multi-gigabyte offsets.
+#define NDOUBLE (NDIRECT + NINDIRECT + NINDIRECT*NINDIRECT)
+#define DENSE (NDOUBLE < FSSIZE/2 ? NDOUBLE : FSSIZE/2)
+
+char buf[BSIZE];
+
+// sparse blocks written after the dense ones.
+uint sparse[] = {
+  (uint)((1L << 32) / BSIZE),       // 4 GB
+  (uint)((10L << 30) / BSIZE),      // 10 GB
+  MAXFILE - 1,                      // the last block
+};
+#define NSPARSE (sizeof(sparse) / sizeof(sparse[0]))
+
+void
+check(int fd, uint bn)
+{
+  if(lseek(fd, (long)bn * BSIZE, SEEK_SET) != (long)bn * BSIZE){
+    printf("bigfile: lseek to block %d failed\n", bn);
+    exit(-1);
+  }
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("bigfile: read error at block %d\n", bn);
+    exit(-1);
+  }
+  if(*(uint*)buf != bn){
+    printf("bigfile: read the wrong data (%d) for block %d\n",
+           *(uint*)buf, bn);
+    exit(-1);
+  }
+}
 
 int
 main()
 {
-  char buf[BSIZE];
+  struct stat st;
   int fd, i, blocks;
+  uint bn;
 
   fd = open("big.file", O_CREATE | O_WRONLY);
   if(fd < 0){
@@ -17,7 +54,7 @@ main()
   }
 
   blocks = 0;
-  while(1){
+  while(blocks < DENSE){
     *(int*)buf = blocks;
     int cc = write(fd, buf, sizeof(buf));
     if(cc <= 0)
@@ -28,12 +65,34 @@ main()
   }
 
   printf("\nwrote %d blocks\n", blocks);
-  if(blocks != 65803) {
+  if(blocks != DENSE) {
     printf("bigfile: file is too small\n");
     exit(-1);
   }
-  
+
+  for(i = 0; i < NSPARSE; i++){
+    bn = sparse[i];
+    if(lseek(fd, (long)bn * BSIZE, SEEK_SET) != (long)bn * BSIZE){
+      printf("bigfile: lseek to block %d failed\n", bn);
+      exit(-1);
+    }
+    *(uint*)buf = bn;
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("bigfile: write at block %d failed\n", bn);
+      exit(-1);
+    }
+  }
+  if(write(fd, buf, sizeof(buf)) > 0){
+    printf("bigfile: wrote past MAXFILE\n");
+    exit(-1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != (uint64)MAXFILE * BSIZE){
+    printf("bigfile: wrong size %l\n", st.size);
+    exit(-1);
+  }
+  printf("wrote %d sparse blocks up to %l bytes\n", NSPARSE, st.size);
   close(fd);
+
   fd = open("big.file", O_RDONLY);
   if(fd < 0){
     printf("bigfile: cannot re-open big.file for reading\n");
@@ -51,8 +110,24 @@ main()
       exit(-1);
     }
   }
+  for(i = 0; i < NSPARSE; i++)
+    check(fd, sparse[i]);
+
+  // the hole before the first sparse block reads as zeros.
+  lseek(fd, (long)(sparse[0] - 1) * BSIZE, SEEK_SET);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("bigfile: read error in hole\n");
+    exit(-1);
+  }
+  for(i = 0; i < BSIZE; i++){
+    if(buf[i] != 0){
+      printf("bigfile: hole is not zero\n");
+      exit(-1);
+    }
+  }
+  close(fd);
 
-  printf("bigfile done; ok\n"); 
+  printf("bigfile done; ok\n");
 
   exit(0);
 }
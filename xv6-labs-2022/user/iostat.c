@@ -0,0 +1,87 @@
+//
+// print the block I/O counters:
+//   iostat
+// or set the disk's completion polling time first,
+// which also clears the disk counters:
+//   iostat -p microseconds
+//
+
+#include "kernel/types.h"
+#include "kernel/iostat.h"
+#include "user/user.h"
+
+// print n as a percentage of d, to one decimal place.
+void
+percent(uint64 n, uint64 d)
+{
+  uint64 x = d ? (n * 1000) / d : 0;
+
+  printf("%d.%d%%", (int)(x / 10), (int)(x % 10));
+}
+
+void
+histogram(char *name, uint64 *lat)
+{
+  int i;
+
+  for(i = 0; i < NDISKLAT; i++){
+    if(lat[i] == 0)
+      continue;
+    if(i == 0)
+      printf("disk: %s  <2us %l\n", name, lat[i]);
+    else if(i == NDISKLAT-1)
+      printf("disk: %s >=%dus %l\n", name, 1 << i, lat[i]);
+    else
+      printf("disk: %s %d-%dus %l\n", name, 1 << i, (1 << (i+1)) - 1, lat[i]);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcachestat st;
+  struct diskstat ds;
+
+  if(argc == 3 && strcmp(argv[1], "-p") == 0){
+    if(diskpoll(atoi(argv[2])) < 0){
+      fprintf(2, "iostat: diskpoll failed\n");
+      exit(1);
+    }
+  } else if(argc != 1){
+    fprintf(2, "usage: iostat [-p microseconds]\n");
+    exit(1);
+  }
+
+  if(bcachestat(&st) < 0){
+    fprintf(2, "iostat: bcachestat failed\n");
+    exit(1);
+  }
+  printf("bcache: %d buffers (target %d, %d grows, %d shrinks)\n",
+         st.nbuf, st.target, st.grows, st.shrinks);
+  printf("bcache: %l hits %l misses ", st.hits, st.misses);
+  percent(st.hits, st.hits + st.misses);
+  printf(" hit rate\n");
+  printf("bcache: %l metadata hits %l misses ", st.metahits, st.metamisses);
+  percent(st.metahits, st.metahits + st.metamisses);
+  printf(" hit rate\n");
+  printf("bcache: %l evictions %l writes %d dirty\n",
+         st.evictions, st.writes, st.dirty);
+  printf("bcache: %l misses overwritten without a read\n", st.noreads);
+  printf("bcache: policy %s, %d buffers on A1\n",
+         st.policy == B2Q ? "2q" : "lru", st.na1);
+
+  if(diskstat(&ds) < 0){
+    fprintf(2, "iostat: diskstat failed\n");
+    exit(1);
+  }
+  printf("disk: queue %d, event-index %s, poll %dus\n",
+         ds.qsize, ds.eventidx ? "on" : "off", ds.poll);
+  printf("disk: %l requests %l blocks %l kicks %l interrupts\n",
+         ds.reqs, ds.blocks, ds.kicks, ds.intrs);
+  printf("disk: %l merged %l past deadline %d queued\n",
+         ds.merged, ds.expired, ds.queued);
+  printf("disk: %l polled %l slept\n", ds.polled, ds.slept);
+  histogram("polled", ds.lat[1]);
+  histogram("slept", ds.lat[0]);
+  exit(0);
+}
@@ -23,12 +23,15 @@ fmtname(char *path)
   return buf;
 }
 
+#define NENT 32
+
+struct direntplus ents[NENT];
+
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, i, n;
+  struct direntplus *d;
   struct stat st;
 
   if((fd = open(path, O_RDONLY)) < 0){
@@ -49,24 +52,15 @@ ls(char *path)
     break;
 
   case T_DIR:
-    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
-      printf("ls: path too long\n");
-      break;
-    }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf("ls: cannot stat %s\n", buf);
-        continue;
+    // a batch of entries, with their types and sizes, per call.
+    while((n = getdents(fd, ents, NENT, 1)) > 0){
+      for(i = 0; i < n; i++){
+        d = &ents[i];
+        printf("%s %d %d %l\n", fmtname(d->name), d->type, d->ino, d->size);
       }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
     }
+    if(n < 0)
+      fprintf(2, "ls: cannot read %s\n", path);
     break;
   }
   close(fd);
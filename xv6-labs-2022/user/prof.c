@@ -0,0 +1,56 @@
+//
+// run a command under the sampling profiler:
+//   prof command [args...]
+// then print one line per sample:
+//   prof: cpu pid name k|u pc [return addresses...]
+// for prof.py to turn into a flat profile and collapsed stacks.
+//
+
+#include "kernel/types.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NS 32
+
+struct profsample samples[NS];
+
+int
+main(int argc, char *argv[])
+{
+  int pid, dropped, total, n, i, j;
+  struct profsample *s;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [args...]\n");
+    exit(1);
+  }
+
+  profile(1);
+  pid = fork();
+  if(pid < 0){
+    profile(0);
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  dropped = profile(0);
+
+  total = 0;
+  while((n = profread(samples, NS)) > 0){
+    for(i = 0; i < n; i++){
+      s = &samples[i];
+      printf("prof: %d %d %s %s", s->cpu, s->pid, s->name, s->user ? "u" : "k");
+      for(j = 0; j < s->depth; j++)
+        printf(" %p", s->pc[j]);
+      printf("\n");
+    }
+    total += n;
+  }
+  printf("prof: %d samples, %d dropped\n", total, dropped);
+  exit(0);
+}
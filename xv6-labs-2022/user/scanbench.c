@@ -0,0 +1,142 @@
+//
+// measure how well the buffer cache keeps hot metadata
+// through a sequential scan, under each replacement policy:
+//   scanbench [nfiles]
+// creates nfiles small files and a file half again as big as
+// the buffer cache. for each policy it warms the cache by
+// stat()ing the small files twice, then repeatedly reads the
+// whole big file and stat()s every small file again, counting
+// metadata (inode and bitmap block) hits during the stats.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/iostat.h"
+#include "user/user.h"
+
+#define ROUNDS 3
+
+char buf[BSIZE];
+char name[16];
+int nfiles = 200;
+
+char*
+fname(int i)
+{
+  name[0] = 's';
+  name[1] = 'b';
+  name[2] = '0' + (i / 100) % 10;
+  name[3] = '0' + (i / 10) % 10;
+  name[4] = '0' + i % 10;
+  name[5] = 0;
+  return name;
+}
+
+void
+statall(void)
+{
+  struct stat st;
+  int i;
+
+  for(i = 0; i < nfiles; i++){
+    if(stat(fname(i), &st) < 0){
+      printf("scanbench: stat %s failed\n", fname(i));
+      exit(1);
+    }
+  }
+}
+
+// read the first n blocks of the big file.
+void
+scan(int n)
+{
+  int fd, i;
+
+  if((fd = open("sb.big", O_RDONLY)) < 0){
+    printf("scanbench: cannot open sb.big\n");
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("scanbench: short read\n");
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+void
+run(int policy, char *pname, int nbig, int nbuf)
+{
+  struct bcachestat s0, s1;
+  uint64 hits, misses;
+  int r;
+
+  bcachepolicy(policy);
+  statall();
+  scan(nbuf / 6);
+  statall();
+
+  hits = misses = 0;
+  for(r = 0; r < ROUNDS; r++){
+    scan(nbig);
+    bcachestat(&s0);
+    statall();
+    bcachestat(&s1);
+    hits += s1.metahits - s0.metahits;
+    misses += s1.metamisses - s0.metamisses;
+  }
+  printf("%s: metadata hits %d misses %d hit rate %d%%\n", pname,
+         (int)hits, (int)misses,
+         hits + misses ? (int)(hits * 100 / (hits + misses)) : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcachestat st;
+  int fd, i, nbig, old;
+
+  if(argc > 1)
+    nfiles = atoi(argv[1]);
+  if(nfiles < 1 || nfiles > 999){
+    fprintf(2, "usage: scanbench [nfiles]\n");
+    exit(1);
+  }
+
+  bcachestat(&st);
+  nbig = st.nbuf + st.nbuf / 2;
+  printf("scanbench: %d buffers, %d small files, %d block scan\n",
+         st.nbuf, nfiles, nbig);
+
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname(i), O_CREATE | O_WRONLY)) < 0){
+      printf("scanbench: cannot create %s\n", fname(i));
+      exit(1);
+    }
+    close(fd);
+  }
+  if((fd = open("sb.big", O_CREATE | O_WRONLY)) < 0){
+    printf("scanbench: cannot create sb.big\n");
+    exit(1);
+  }
+  for(i = 0; i < nbig; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("scanbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  old = bcachepolicy(BLRU);
+  run(BLRU, "lru", nbig, st.nbuf);
+  run(B2Q, "2q", nbig, st.nbuf);
+  bcachepolicy(old);
+
+  for(i = 0; i < nfiles; i++)
+    unlink(fname(i));
+  unlink("sb.big");
+  exit(0);
+}
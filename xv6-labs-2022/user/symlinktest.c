@@ -13,6 +13,7 @@
 static int failed = 0;
 
 static void testsymlink(void);
+static void testpaths(void);
 static void concur(void);
 static void cleanup(void);
 
@@ -21,6 +22,7 @@ main(int argc, char *argv[])
 {
   cleanup();
   testsymlink();
+  testpaths();
   concur();
   exit(failed);
 }
@@ -37,6 +39,13 @@ cleanup(void)
   unlink("/testsymlink/4");
   unlink("/testsymlink/z");
   unlink("/testsymlink/y");
+  unlink("/testsymlink/d/fl");
+  unlink("/testsymlink/d/f");
+  unlink("/testsymlink/d");
+  unlink("/testsymlink/dl");
+  unlink("/testsymlink/rl");
+  unlink("/testsymlink/l1");
+  unlink("/testsymlink/l2");
   unlink("/testsymlink");
 }
 
@@ -131,6 +140,76 @@ done:
   close(fd2);
 }
 
+// read the first byte of pn, or return -1.
+static int
+readbyte(char *pn)
+{
+  char c;
+  int fd, r;
+
+  if((fd = open(pn, O_RDONLY)) < 0)
+    return -1;
+  r = read(fd, &c, 1);
+  close(fd);
+  return r == 1 ? c : -1;
+}
+
+// symbolic links in the middle of a path, with absolute and
+// relative targets, and loops.
+static void
+testpaths(void)
+{
+  int fd;
+  struct stat st;
+
+  printf("Start: test symlinks in paths\n");
+
+  if(mkdir("/testsymlink/d") != 0)
+    fail("failed to mkdir d");
+  fd = open("/testsymlink/d/f", O_CREATE | O_RDWR);
+  if(fd < 0 || write(fd, "x", 1) != 1)
+    fail("failed to write d/f");
+  close(fd);
+
+  if(symlink("/testsymlink/d", "/testsymlink/dl") != 0)
+    fail("symlink dl -> /testsymlink/d failed");
+  if(readbyte("/testsymlink/dl/f") != 'x')
+    fail("failed to read dl/f through an absolute link");
+
+  // relative targets are looked up from the link's directory.
+  if(symlink("d", "/testsymlink/rl") != 0)
+    fail("symlink rl -> d failed");
+  if(symlink("f", "/testsymlink/d/fl") != 0)
+    fail("symlink d/fl -> f failed");
+  if(readbyte("/testsymlink/rl/f") != 'x')
+    fail("failed to read rl/f through a relative link");
+  if(readbyte("/testsymlink/rl/fl") != 'x')
+    fail("failed to read rl/fl through two relative links");
+  if(readbyte("/testsymlink/dl/../dl/fl") != 'x')
+    fail("failed to read dl/../dl/fl");
+
+  // O_NOFOLLOW applies only to the last element.
+  fd = open("/testsymlink/dl/fl", O_RDONLY | O_NOFOLLOW);
+  if(fd < 0 || fstat(fd, &st) != 0 || st.type != T_SYMLINK)
+    fail("O_NOFOLLOW didn't open dl/fl itself");
+  close(fd);
+
+  // a loop fails, at the end of a path or in the middle.
+  if(symlink("/testsymlink/l2", "/testsymlink/l1") != 0 ||
+     symlink("l1", "/testsymlink/l2") != 0)
+    fail("failed to make the l1 <-> l2 loop");
+  if(open("/testsymlink/l1", O_RDONLY) >= 0)
+    fail("opened l1 through a loop");
+  if(open("/testsymlink/l1/f", O_RDONLY) >= 0)
+    fail("opened l1/f through a loop");
+  if(stat("/testsymlink/l2/f", &st) != -1)
+    fail("stat of l2/f through a loop succeeded");
+
+  printf("test symlinks in paths: ok\n");
+done:
+  ;
+}
+
 static void
 concur(void)
 {
@@ -1,4 +1,9 @@
 struct stat;
+struct profsample;
+struct bcachestat;
+struct diskstat;
+struct iovec;
+struct direntplus;
 
 // system calls
 int fork(void);
@@ -23,9 +28,24 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int symlink(const char*, const char*);
+int profile(int);
+int profread(struct profsample*, int);
+int bcachestat(struct bcachestat*);
+int bcachepolicy(int);
+int diskstat(struct diskstat*);
+int diskpoll(int);
+long lseek(int, long, int);
+int pread(int, void*, int, long);
+int pwrite(int, const void*, int, long);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int getdents(int, struct direntplus*, int, int);
+int stat(const char*, struct stat*);
+int openat(int, const char*, int);
+int fstatat(int, const char*, struct stat*, int);
+int rename(const char*, const char*);
 
 // ulib.c
-int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
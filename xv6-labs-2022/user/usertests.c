@@ -4,6 +4,7 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -575,6 +576,12 @@ writetest(char *s)
   }
 }
 
+// write a file out to the end of its doubly-indirect blocks,
+// or over half the disk if that is less; a file of MAXFILE
+// blocks wouldn't fit on the disk.
+#define NDOUBLE (NDIRECT + NINDIRECT + NINDIRECT*NINDIRECT)
+#define BIGBLOCKS (NDOUBLE < FSSIZE/2 ? NDOUBLE : FSSIZE/2)
+
 void
 writebig(char *s)
 {
@@ -586,7 +593,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -606,7 +613,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -1778,6 +1785,419 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// seek past the end and write; the hole should read as zeros.
+void
+sparse(char *s)
+{
+  enum { OFF = 5*1024*1024 };
+  struct stat st;
+  int fd, i;
+
+  unlink("sparse.dat");
+  fd = open("sparse.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create sparse.dat\n", s);
+    exit(1);
+  }
+  if(lseek(fd, OFF, SEEK_SET) != OFF){
+    printf("%s: lseek past end failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "x", 1) != 1){
+    printf("%s: write after hole failed\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != OFF + 1){
+    printf("%s: wrong size %d\n", s, st.size);
+    exit(1);
+  }
+  if(lseek(fd, OFF / 2, SEEK_SET) != OFF / 2){
+    printf("%s: lseek failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', BSIZE);
+  if(read(fd, buf, BSIZE) != BSIZE){
+    printf("%s: read of hole failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < BSIZE; i++){
+    if(buf[i] != 0){
+      printf("%s: hole not zero\n", s);
+      exit(1);
+    }
+  }
+  if(lseek(fd, -1, SEEK_END) != OFF || read(fd, buf, 2) != 1 || buf[0] != 'x'){
+    printf("%s: read after hole failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("sparse.dat");
+}
+
+// writev() and readv() several buffers; pread() and pwrite()
+// at offsets without moving the file's offset.
+void
+vectorio(char *s)
+{
+  struct iovec iov[3];
+  char a[8], b[8];
+  int fd;
+
+  unlink("vio.dat");
+  fd = open("vio.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create vio.dat\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "head";
+  iov[0].iov_len = 4;
+  iov[1].iov_base = "";
+  iov[1].iov_len = 0;
+  iov[2].iov_base = "body";
+  iov[2].iov_len = 4;
+  if(writev(fd, iov, 3) != 8){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "BO", 2, 4) != 2){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, a, 4, 2) != 4 || memcmp(a, "adBO", 4) != 0){
+    printf("%s: pread read the wrong data\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_CUR) != 8){
+    printf("%s: pread or pwrite moved the offset\n", s);
+    exit(1);
+  }
+  lseek(fd, 0, SEEK_SET);
+  iov[0].iov_base = a;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 8;
+  if(readv(fd, iov, 2) != 8 || memcmp(a, "hea", 3) != 0 || memcmp(b, "dBOdy", 5) != 0){
+    printf("%s: readv read the wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("vio.dat");
+}
+
+// two writers fill the ordered list of one transaction, with
+// blocks that were indirect blocks a moment ago and may still
+// be waiting to be checkpointed.
+void
+orderedfull(char *s)
+{
+  char *p, name[5];
+  int fd, i, j, k, n, pid, xstatus;
+
+  n = NORDERED * BSIZE;
+  if((p = malloc(n)) == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+  // a sparse file with a few blocks each under several
+  // doubly-indirect blocks, freed at once.
+  unlink("of.old");
+  if((fd = open("of.old", O_CREATE | O_WRONLY)) < 0){
+    printf("%s: cannot create of.old\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 8; i++){
+    lseek(fd, (long)(NDIRECT + NINDIRECT + i*NINDIRECT) * BSIZE, SEEK_SET);
+    if(write(fd, p, BSIZE) != BSIZE){
+      printf("%s: write of.old failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("of.old");
+
+  strcpy(name, "of.0");
+  for(k = 0; k < 2; k++){
+    name[3] = '0' + k;
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      memset(p, 'a' + k, n);
+      if((fd = open(name, O_CREATE | O_WRONLY)) < 0){
+        printf("%s: cannot create %s\n", s, name);
+        exit(1);
+      }
+      for(i = 0; i < 2; i++){
+        if(write(fd, p, n) != n){
+          printf("%s: write %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      close(fd);
+      exit(0);
+    }
+  }
+  for(k = 0; k < 2; k++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+
+  for(k = 0; k < 2; k++){
+    name[3] = '0' + k;
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("%s: cannot open %s\n", s, name);
+      exit(1);
+    }
+    for(i = 0; i < 2; i++){
+      if(read(fd, p, n) != n){
+        printf("%s: short read from %s\n", s, name);
+        exit(1);
+      }
+      for(j = 0; j < n; j++){
+        if(p[j] != 'a' + k){
+          printf("%s: %s has the wrong data\n", s, name);
+          exit(1);
+        }
+      }
+    }
+    close(fd);
+    unlink(name);
+  }
+  free(p);
+}
+
+// getdents() returns the live entries of a directory, in
+// batches bigger than the kernel's, with the inode fields
+// only if plus is set, and moves the file offset.
+void
+getdentstest(char *s)
+{
+  struct direntplus ents[32];
+  struct stat st;
+  char path[16], seen[20];
+  int fd, i, j, n, tot;
+
+  mkdir("gd.dir");
+  strcpy(path, "gd.dir/f00");
+  for(i = 0; i < 20; i++){
+    path[8] = '0' + i / 10;
+    path[9] = '0' + i % 10;
+    if((fd = open(path, O_CREATE | O_WRONLY)) < 0 || write(fd, ents, i) != i){
+      printf("%s: cannot create %s\n", s, path);
+      exit(1);
+    }
+    close(fd);
+  }
+  // leave two empty slots.
+  unlink("gd.dir/f03");
+  unlink("gd.dir/f07");
+
+  if((fd = open("gd.dir", O_RDONLY)) < 0){
+    printf("%s: cannot open gd.dir\n", s);
+    exit(1);
+  }
+  // a bad buffer consumes nothing.
+  if(getdents(fd, (struct direntplus*)0xffffffffffffULL, 32, 1) != -1){
+    printf("%s: getdents into a bad buffer succeeded\n", s);
+    exit(1);
+  }
+  if((n = getdents(fd, ents, 32, 1)) != 20){
+    printf("%s: getdents returned %d, not 20\n", s, n);
+    exit(1);
+  }
+  memset(seen, 0, sizeof(seen));
+  for(j = 0; j < n; j++){
+    if(ents[j].name[0] == '.'){
+      if(ents[j].type != T_DIR){
+        printf("%s: %s is not a directory\n", s, ents[j].name);
+        exit(1);
+      }
+      continue;
+    }
+    i = (ents[j].name[1] - '0') * 10 + ents[j].name[2] - '0';
+    strcpy(path + 7, ents[j].name);
+    if(i < 0 || i >= 20 || i == 3 || i == 7 || seen[i] || stat(path, &st) < 0){
+      printf("%s: unexpected entry %s\n", s, ents[j].name);
+      exit(1);
+    }
+    seen[i] = 1;
+    if(ents[j].ino != st.ino || ents[j].type != T_FILE ||
+       ents[j].nlink != 1 || ents[j].size != i){
+      printf("%s: wrong fields for %s\n", s, ents[j].name);
+      exit(1);
+    }
+  }
+  if(getdents(fd, ents, 32, 1) != 0){
+    printf("%s: getdents didn't return 0 at the end\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // smaller batches, without the inode fields.
+  fd = open("gd.dir", O_RDONLY);
+  tot = 0;
+  while((n = getdents(fd, ents, 7, 0)) > 0){
+    for(j = 0; j < n; j++){
+      if(ents[j].ino == 0 || ents[j].type || ents[j].nlink || ents[j].size){
+        printf("%s: wrong fields without plus\n", s);
+        exit(1);
+      }
+    }
+    tot += n;
+  }
+  if(n != 0 || tot != 20){
+    printf("%s: read %d entries in batches\n", s, tot);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("gd.dir/f00", O_RDONLY);
+  if(getdents(fd, ents, 32, 1) != -1){
+    printf("%s: getdents of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < 20; i++){
+    path[8] = '0' + i / 10;
+    path[9] = '0' + i % 10;
+    path[10] = 0;
+    unlink(path);
+  }
+  if(unlink("gd.dir") != 0){
+    printf("%s: unlink gd.dir failed\n", s);
+    exit(1);
+  }
+}
+
+// openat() and fstatat() resolve relative paths from a
+// directory fd; stat() needs no open file.
+void
+atcalls(char *s)
+{
+  struct stat st;
+  int dfd, fd;
+
+  unlink("atdir/f");
+  unlink("atdir");
+  if(mkdir("atdir") != 0){
+    printf("%s: mkdir atdir failed\n", s);
+    exit(1);
+  }
+  if((dfd = open("atdir", O_RDONLY)) < 0){
+    printf("%s: cannot open atdir\n", s);
+    exit(1);
+  }
+  if((fd = openat(dfd, "f", O_CREATE | O_RDWR)) < 0){
+    printf("%s: openat create failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "abc", 3) != 3){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(stat("atdir/f", &st) < 0 || st.type != T_FILE || st.size != 3){
+    printf("%s: stat atdir/f wrong\n", s);
+    exit(1);
+  }
+  if(fstatat(dfd, "f", &st, 0) < 0 || st.size != 3){
+    printf("%s: fstatat f wrong\n", s);
+    exit(1);
+  }
+  if(fstatat(AT_FDCWD, "atdir", &st, 0) < 0 || st.type != T_DIR){
+    printf("%s: fstatat AT_FDCWD wrong\n", s);
+    exit(1);
+  }
+  if(stat("f", &st) == 0 || fstatat(dfd, "nonexistent", &st, 0) == 0){
+    printf("%s: stat of a missing file succeeded\n", s);
+    exit(1);
+  }
+  if(fstatat(0, "f", &st, 0) == 0){
+    printf("%s: fstatat with a non-directory fd succeeded\n", s);
+    exit(1);
+  }
+  close(dfd);
+  unlink("atdir/f");
+  unlink("atdir");
+}
+
+// rename() replaces an existing target, moves directories
+// between parents, and refuses to make a loop.
+void
+renametest(char *s)
+{
+  struct stat st;
+  char buf[4];
+  int fd;
+
+  unlink("rn.a");
+  unlink("rn.b");
+  if((fd = open("rn.a", O_CREATE | O_WRONLY)) < 0 || write(fd, "new", 3) != 3){
+    printf("%s: cannot write rn.a\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("rn.b", O_CREATE | O_WRONLY)) < 0 || write(fd, "old", 3) != 3){
+    printf("%s: cannot write rn.b\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(rename("rn.a", "rn.b") != 0){
+    printf("%s: rename rn.a rn.b failed\n", s);
+    exit(1);
+  }
+  if(stat("rn.a", &st) == 0){
+    printf("%s: rn.a still exists\n", s);
+    exit(1);
+  }
+  fd = open("rn.b", O_RDONLY);
+  if(fd < 0 || read(fd, buf, 3) != 3 || memcmp(buf, "new", 3) != 0){
+    printf("%s: rn.b has the wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // move a directory into another one.
+  unlink("rn.d1/rn.d2/f");
+  unlink("rn.d1/rn.d2");
+  unlink("rn.d2");
+  unlink("rn.d1");
+  if(mkdir("rn.d1") != 0 || mkdir("rn.d2") != 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if(rename("rn.b", "rn.d2/f") != 0 || rename("rn.d2", "rn.d1/rn.d2") != 0){
+    printf("%s: rename into a directory failed\n", s);
+    exit(1);
+  }
+  if(stat("rn.d1/rn.d2/f", &st) != 0 || st.size != 3){
+    printf("%s: moved file is missing\n", s);
+    exit(1);
+  }
+  if(fstatat(AT_FDCWD, "rn.d1/rn.d2/../rn.d2/f", &st, 0) != 0){
+    printf("%s: .. not updated\n", s);
+    exit(1);
+  }
+  if(rename("rn.d1", "rn.d1/rn.d2/x") == 0){
+    printf("%s: moved a directory below itself\n", s);
+    exit(1);
+  }
+  if(mkdir("rn.d2") != 0 || rename("rn.d2", "rn.d1") == 0){
+    printf("%s: replaced a non-empty directory\n", s);
+    exit(1);
+  }
+  unlink("rn.d2");
+  unlink("rn.d1/rn.d2/f");
+  unlink("rn.d1/rn.d2");
+  if(unlink("rn.d1") != 0){
+    printf("%s: unlink rn.d1 failed\n", s);
+    exit(1);
+  }
+}
+
 void
 fourteen(char *s)
 {
@@ -2613,6 +3033,12 @@ struct test {
   {subdir, "subdir"},
   {bigwrite, "bigwrite"},
   {bigfile, "bigfile"},
+  {sparse, "sparse"},
+  {vectorio, "vectorio"},
+  {orderedfull, "orderedfull"},
+  {getdentstest, "getdentstest"},
+  {atcalls, "atcalls"},
+  {renametest, "renametest"},
   {fourteen, "fourteen"},
   {rmdot, "rmdot"},
   {dirfile, "dirfile"},
@@ -36,4 +36,20 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
-entry("symlink");
\ No newline at end of file
+entry("symlink");
+entry("profile");
+entry("profread");
+entry("bcachestat");
+entry("bcachepolicy");
+entry("diskstat");
+entry("diskpoll");
+entry("lseek");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("getdents");
+entry("stat");
+entry("openat");
+entry("fstatat");
+entry("rename");
\ No newline at end of file